@@ -0,0 +1,233 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "benchcommon.h"
+#include "rimeapi.h"
+#include "testfrontend_public.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/event.h>
+#include <fcitx/inputcontextmanager.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <ostream>
+#include <rime_api.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+const char *const headlessUsage =
+    "  --librime               Use librime instead of the mock\n"
+    "  --rime-data DIR         Copy DIR into the rime user directory\n"
+    "  --log RULE              Fcitx log rule, default *=3\n";
+
+uint64_t timestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string escapeJson(std::string_view str) {
+    std::string result;
+    for (char c : str) {
+        switch (c) {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                result += buf;
+            } else {
+                result += c;
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+void writeSamples(std::ostream &out, std::vector<uint64_t> samples) {
+    std::sort(samples.begin(), samples.end());
+    uint64_t total = 0;
+    for (auto sample : samples) {
+        total += sample;
+    }
+    auto percentile = [&samples](double quantile) -> uint64_t {
+        if (samples.empty()) {
+            return 0;
+        }
+        return samples[static_cast<size_t>(quantile * (samples.size() - 1))];
+    };
+    out << "\"samples\": " << samples.size() << ", "
+        << "\"total_ns\": " << total << ", "
+        << "\"mean_ns\": " << (samples.empty() ? 0 : total / samples.size())
+        << ", "
+        << "\"p50_ns\": " << percentile(0.5) << ", "
+        << "\"p95_ns\": " << percentile(0.95) << ", "
+        << "\"p99_ns\": " << percentile(0.99) << ", "
+        << "\"max_ns\": " << (samples.empty() ? 0 : samples.back()) << ", "
+        << "\"ops_per_sec\": " << (total ? samples.size() * 1e9 / total : 0.0);
+}
+
+bool parseHeadlessOption(std::string_view arg,
+                         const std::function<std::string()> &next,
+                         HeadlessOptions &options) {
+    if (arg == "--librime") {
+        options.librime = true;
+    } else if (arg == "--rime-data") {
+        options.rimeData = next();
+    } else if (arg == "--log") {
+        options.logRule = next();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int runHeadless(const HeadlessOptions &options, const char *name,
+                const std::function<void(Instance *)> &callback) {
+    setupTestingEnvironment(FCITX_RIME_BENCH_BINARY_DIR, {"bin"}, {"bench"});
+    Log::setLogRule(options.logRule);
+
+    // librime needs a writable user directory, the testing environment
+    // points it to an invalid path.
+    std::filesystem::path userDir;
+    if (options.librime) {
+        unsetenv("FCITX_RIME_API_LIBRARY");
+        char pattern[] = "/tmp/fcitx5-rime-bench-XXXXXX";
+        if (!mkdtemp(pattern)) {
+            std::cerr << "Failed to create a temporary directory\n";
+            return 1;
+        }
+        userDir = pattern;
+        unsetenv("SKIP_FCITX_USER_PATH");
+        setenv("FCITX_DATA_HOME", userDir.c_str(), 1);
+        setenv("FCITX_CONFIG_HOME", userDir.c_str(), 1);
+        if (!options.rimeData.empty()) {
+            std::filesystem::copy(options.rimeData, userDir / "rime",
+                                  std::filesystem::copy_options::recursive);
+        }
+    } else {
+        setenv("FCITX_RIME_API_LIBRARY", FCITX_RIME_MOCK_LIBRARY, 0);
+    }
+
+    std::string arg0 = name;
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testfrontend,rime";
+    char *argv[] = {arg0.data(), arg1, arg2};
+    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+
+    int ret = 0;
+    instance.eventDispatcher().schedule([&instance, &callback, &ret]() {
+        try {
+            callback(&instance);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << '\n';
+            ret = 1;
+        }
+        instance.exit();
+    });
+    instance.exec();
+
+    if (!userDir.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(userDir, ec);
+    }
+    return ret;
+}
+
+HeadlessRime::HeadlessRime(Instance *instance)
+    : instance_(instance), api_(loadRimeApi()) {
+    testfrontend_ = instance_->addonManager().addon("testfrontend", true);
+    rime_ = instance_->addonManager().addon("rime", true);
+    if (!testfrontend_ || !rime_) {
+        throw std::runtime_error("Failed to load rime or testfrontend");
+    }
+    auto group = instance_->inputMethodManager().currentGroup();
+    group.inputMethodList().emplace_back("rime");
+    instance_->inputMethodManager().setGroup(std::move(group));
+    commitWatcher_ = instance_->watchEvent(
+        EventType::InputContextCommitString, EventWatcherPhase::Default,
+        [this](Event &event) {
+            commits_ += 1;
+            if (commitCallback_) {
+                auto &commitEvent = static_cast<CommitStringEvent &>(event);
+                commitCallback_(commitEvent.inputContext(),
+                                commitEvent.text());
+            }
+        });
+    waitForMaintenance();
+}
+
+HeadlessRime::~HeadlessRime() {
+    for (const auto &uuid : uuids_) {
+        testfrontend_->call<ITestFrontend::destroyInputContext>(uuid);
+    }
+}
+
+InputContext *HeadlessRime::createInputContext(const std::string &program) {
+    auto uuid = testfrontend_->call<ITestFrontend::createInputContext>(
+        program.empty() ? "rime-bench" : program);
+    auto *ic = instance_->inputContextManager().findByUUID(uuid);
+    if (!ic) {
+        throw std::runtime_error("Failed to create input context");
+    }
+    uuids_.push_back(uuid);
+    ic->focusIn();
+    instance_->setCurrentInputMethod(ic, "rime", /*local=*/true);
+    return ic;
+}
+
+void HeadlessRime::destroyInputContext(InputContext *ic) {
+    auto uuid = ic->uuid();
+    std::erase(uuids_, uuid);
+    testfrontend_->call<ITestFrontend::destroyInputContext>(uuid);
+}
+
+bool HeadlessRime::sendKey(InputContext *ic, const Key &key, bool isRelease) {
+    return testfrontend_->call<ITestFrontend::keyEvent>(ic->uuid(), key,
+                                                       isRelease);
+}
+
+void HeadlessRime::type(InputContext *ic, std::string_view text) {
+    for (char c : text) {
+        sendKey(ic, Key(static_cast<KeySym>(c)));
+    }
+}
+
+void HeadlessRime::waitForMaintenance() {
+    while (api_->is_maintenance_mode()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+} // namespace fcitx::rime
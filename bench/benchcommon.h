@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIME_BENCHCOMMON_H_
+#define _FCITX_RIME_BENCHCOMMON_H_
+
+#include <cstdint>
+#include <fcitx-utils/handlertable.h>
+#include <fcitx-utils/key.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/event.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/instance.h>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <rime_api.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+// Options shared by every tool that runs the addon headless.
+struct HeadlessOptions {
+    // Use librime instead of the mock.
+    bool librime = false;
+    // Copied into the rime user directory when using librime.
+    std::string rimeData;
+    std::string logRule = "*=3";
+};
+
+uint64_t timestamp();
+
+template <typename F>
+uint64_t measure(F &&callback) {
+    const auto start = timestamp();
+    callback();
+    return timestamp() - start;
+}
+
+std::string escapeJson(std::string_view str);
+
+// Write the distribution of samples in nanoseconds as JSON object members.
+void writeSamples(std::ostream &out, std::vector<uint64_t> samples);
+
+// Consume arg, and its value from next() if needed, if it is one of the
+// headless options.
+bool parseHeadlessOption(std::string_view arg,
+                         const std::function<std::string()> &next,
+                         HeadlessOptions &options);
+extern const char *const headlessUsage;
+
+// Set up the environment, run callback from the event loop of a headless
+// instance with rime and the test frontend, and return the exit code.
+int runHeadless(const HeadlessOptions &options, const char *name,
+                const std::function<void(Instance *)> &callback);
+
+// Drives input contexts of the test frontend with rime as input method.
+class HeadlessRime {
+public:
+    using CommitCallback =
+        std::function<void(InputContext *, const std::string &)>;
+
+    explicit HeadlessRime(Instance *instance);
+    ~HeadlessRime();
+
+    rime_api_t *api() const { return api_; }
+    AddonInstance *rime() const { return rime_; }
+    uint64_t commits() const { return commits_; }
+    void setCommitCallback(CommitCallback callback) {
+        commitCallback_ = std::move(callback);
+    }
+
+    InputContext *createInputContext(const std::string &program = "");
+    void destroyInputContext(InputContext *ic);
+    bool sendKey(InputContext *ic, const Key &key, bool isRelease = false);
+    void type(InputContext *ic, std::string_view text);
+    void waitForMaintenance();
+
+private:
+    Instance *instance_;
+    rime_api_t *api_;
+    AddonInstance *testfrontend_;
+    AddonInstance *rime_;
+    std::unique_ptr<HandlerTableEntry<EventHandler>> commitWatcher_;
+    CommitCallback commitCallback_;
+    std::vector<ICUUID> uuids_;
+    uint64_t commits_ = 0;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIME_BENCHCOMMON_H_
@@ -0,0 +1,716 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// An in-memory replacement of librime with deterministic behavior, load it
+// by setting FCITX_RIME_API_LIBRARY to the path of this library. Only the
+// addon built with ENABLE_BENCHMARK honors it.
+//
+// Lower case letters are appended to the input. Every input has
+// FCITX_RIME_MOCK_CANDIDATES candidates (default 30) named "<input>:<n>",
+// shown FCITX_RIME_MOCK_PAGE_SIZE (default 5) at a time. Space or digits
+// select a candidate, Return commits the raw input, BackSpace, Escape,
+// Page_Up, Page_Down, Up and Down work as usual. Everything else, and every
+// key in ascii mode, is not handled. Schemas are configured like a simple
+// pinyin schema, so the addon bypasses the other keys while not composing.
+//
+// Like librime, it must not be used by two threads at the same time.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <rime_api.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int ShiftMask = 1 << 0;
+constexpr int ControlMask = 1 << 2;
+constexpr int Mod1Mask = 1 << 3;
+constexpr int SuperMask = 1 << 26;
+constexpr int ReleaseMask = 1 << 30;
+
+constexpr int KeyBackSpace = 0xff08;
+constexpr int KeyReturn = 0xff0d;
+constexpr int KeyEscape = 0xff1b;
+constexpr int KeyUp = 0xff52;
+constexpr int KeyDown = 0xff54;
+constexpr int KeyPageUp = 0xff55;
+constexpr int KeyPageDown = 0xff56;
+
+struct MockSchema {
+    const char *id;
+    const char *name;
+};
+
+constexpr MockSchema schemas[] = {{"mock_pinyin", "Mock Pinyin"},
+                                  {"mock_table", "Mock Table"}};
+
+struct MockSession {
+    std::string schema = schemas[0].id;
+    std::string input;
+    size_t page = 0;
+    size_t highlighted = 0;
+    std::string commit;
+    std::map<std::string, bool> options;
+    std::map<std::string, std::string> properties;
+};
+
+struct MockState {
+    RimeNotificationHandler handler = nullptr;
+    void *handlerContext = nullptr;
+    RimeSessionId nextSession = 1;
+    std::unordered_map<RimeSessionId, MockSession> sessions;
+    size_t numCandidates = 30;
+    size_t pageSize = 5;
+};
+
+MockState &state() {
+    static MockState state;
+    return state;
+}
+
+size_t envNumber(const char *name, size_t defaultValue) {
+    const char *value = std::getenv(name);
+    if (!value || !value[0]) {
+        return defaultValue;
+    }
+    const auto result = std::strtoul(value, nullptr, 10);
+    return result ? result : defaultValue;
+}
+
+void notify(RimeSessionId session, const char *type, const char *value) {
+    if (state().handler) {
+        state().handler(state().handlerContext, session, type, value);
+    }
+}
+
+MockSession *findSession(RimeSessionId id) {
+    auto iter = state().sessions.find(id);
+    return iter == state().sessions.end() ? nullptr : &iter->second;
+}
+
+char *copyString(const std::string &str) {
+    auto *result = new char[str.size() + 1];
+    std::memcpy(result, str.data(), str.size() + 1);
+    return result;
+}
+
+std::string candidateText(const MockSession &session, size_t index) {
+    return session.input + ":" + std::to_string(index);
+}
+
+std::string candidateComment(size_t index) {
+    return index % 3 == 0 ? "~" + std::to_string(index) : "";
+}
+
+size_t pageStart(const MockSession &session) {
+    return session.page * state().pageSize;
+}
+
+size_t pageLength(const MockSession &session) {
+    if (session.input.empty()) {
+        return 0;
+    }
+    const auto start = pageStart(session);
+    return std::min(state().pageSize, state().numCandidates - start);
+}
+
+void resetComposition(MockSession &session) {
+    session.input.clear();
+    session.page = 0;
+    session.highlighted = 0;
+}
+
+bool selectCandidate(MockSession &session, size_t index) {
+    if (session.input.empty() || index >= state().numCandidates) {
+        return false;
+    }
+    session.commit += candidateText(session, index);
+    resetComposition(session);
+    return true;
+}
+
+void setup(RimeTraits * /*traits*/) {}
+
+void setNotificationHandler(RimeNotificationHandler handler, void *context) {
+    state().handler = handler;
+    state().handlerContext = context;
+}
+
+void initialize(RimeTraits * /*traits*/) {
+    state().numCandidates = envNumber("FCITX_RIME_MOCK_CANDIDATES", 30);
+    state().pageSize = envNumber("FCITX_RIME_MOCK_PAGE_SIZE", 5);
+}
+
+void finalize() { state().sessions.clear(); }
+
+Bool startMaintenance(Bool /*fullCheck*/) {
+    notify(0, "deploy", "start");
+    notify(0, "deploy", "success");
+    return True;
+}
+
+Bool isMaintenanceMode() { return False; }
+
+Bool deployConfigFile(const char * /*file*/, const char * /*key*/) {
+    return True;
+}
+
+Bool syncUserData() {
+    notify(0, "deploy", "start");
+    notify(0, "deploy", "success");
+    return True;
+}
+
+RimeSessionId createSession() {
+    auto id = state().nextSession++;
+    state().sessions.emplace(id, MockSession());
+    return id;
+}
+
+Bool sessionExists(RimeSessionId id) { return findSession(id) != nullptr; }
+
+Bool destroySession(RimeSessionId id) {
+    return state().sessions.erase(id) > 0;
+}
+
+void changePage(MockSession &session, bool backward) {
+    if (backward) {
+        if (session.page) {
+            session.page -= 1;
+            session.highlighted = 0;
+        }
+    } else if (pageStart(session) + state().pageSize < state().numCandidates) {
+        session.page += 1;
+        session.highlighted = 0;
+    }
+}
+
+Bool processKey(RimeSessionId id, int keycode, int mask) {
+    auto *session = findSession(id);
+    if (!session || (mask & ReleaseMask) ||
+        (mask & (ControlMask | Mod1Mask | SuperMask)) ||
+        session->options["ascii_mode"]) {
+        return False;
+    }
+    const bool composing = !session->input.empty();
+    if (keycode >= 'a' && keycode <= 'z' && !(mask & ShiftMask)) {
+        session->input.push_back(static_cast<char>(keycode));
+        session->page = 0;
+        session->highlighted = 0;
+        return True;
+    }
+    if (!composing) {
+        return False;
+    }
+    switch (keycode) {
+    case ' ':
+        return selectCandidate(*session,
+                               pageStart(*session) + session->highlighted);
+    case KeyReturn:
+        session->commit += session->input;
+        resetComposition(*session);
+        return True;
+    case KeyBackSpace:
+        session->input.pop_back();
+        session->page = 0;
+        session->highlighted = 0;
+        return True;
+    case KeyEscape:
+        resetComposition(*session);
+        return True;
+    case KeyPageDown:
+        changePage(*session, /*backward=*/false);
+        return True;
+    case KeyPageUp:
+        changePage(*session, /*backward=*/true);
+        return True;
+    case KeyDown:
+        if (session->highlighted + 1 < pageLength(*session)) {
+            session->highlighted += 1;
+        }
+        return True;
+    case KeyUp:
+        if (session->highlighted) {
+            session->highlighted -= 1;
+        }
+        return True;
+    default:
+        break;
+    }
+    if (keycode >= '1' && keycode <= '9') {
+        const size_t index = keycode - '1';
+        if (index < pageLength(*session)) {
+            return selectCandidate(*session, pageStart(*session) + index);
+        }
+        return True;
+    }
+    return False;
+}
+
+void clearComposition(RimeSessionId id) {
+    if (auto *session = findSession(id)) {
+        resetComposition(*session);
+    }
+}
+
+Bool getCommit(RimeSessionId id, RimeCommit *commit) {
+    auto *session = findSession(id);
+    if (!session || session->commit.empty()) {
+        return False;
+    }
+    commit->text = copyString(session->commit);
+    session->commit.clear();
+    return True;
+}
+
+Bool freeCommit(RimeCommit *commit) {
+    delete[] commit->text;
+    commit->text = nullptr;
+    return True;
+}
+
+Bool getContext(RimeSessionId id, RimeContext *context) {
+    auto *session = findSession(id);
+    if (!session) {
+        return False;
+    }
+    const auto &input = session->input;
+    context->composition.length = static_cast<int>(input.size());
+    context->composition.cursor_pos = static_cast<int>(input.size());
+    context->composition.sel_start = 0;
+    context->composition.sel_end = static_cast<int>(input.size());
+    context->composition.preedit = input.empty() ? nullptr : copyString(input);
+
+    const auto start = pageStart(*session);
+    const auto length = pageLength(*session);
+    auto &menu = context->menu;
+    menu.page_size = static_cast<int>(state().pageSize);
+    menu.page_no = static_cast<int>(session->page);
+    menu.is_last_page = start + length >= state().numCandidates;
+    menu.highlighted_candidate_index = static_cast<int>(session->highlighted);
+    menu.num_candidates = static_cast<int>(length);
+    menu.candidates = nullptr;
+    if (length) {
+        menu.candidates = new RimeCandidate[length];
+        for (size_t i = 0; i < length; i++) {
+            menu.candidates[i].text =
+                copyString(candidateText(*session, start + i));
+            const auto comment = candidateComment(start + i);
+            menu.candidates[i].comment =
+                comment.empty() ? nullptr : copyString(comment);
+            menu.candidates[i].reserved = nullptr;
+        }
+    }
+    menu.select_keys = nullptr;
+    context->commit_text_preview =
+        length ? copyString(candidateText(*session, start)) : nullptr;
+    auto &result = *context;
+    if (RIME_STRUCT_HAS_MEMBER(result, result.select_labels)) {
+        result.select_labels = nullptr;
+    }
+    return True;
+}
+
+Bool freeContext(RimeContext *context) {
+    delete[] context->composition.preedit;
+    for (int i = 0; i < context->menu.num_candidates; i++) {
+        delete[] context->menu.candidates[i].text;
+        delete[] context->menu.candidates[i].comment;
+    }
+    delete[] context->menu.candidates;
+    delete[] context->commit_text_preview;
+    context->composition.preedit = nullptr;
+    context->menu.candidates = nullptr;
+    context->menu.num_candidates = 0;
+    context->commit_text_preview = nullptr;
+    return True;
+}
+
+Bool getStatus(RimeSessionId id, RimeStatus *status) {
+    auto *session = findSession(id);
+    if (!session) {
+        return False;
+    }
+    std::string name = session->schema;
+    for (const auto &schema : schemas) {
+        if (session->schema == schema.id) {
+            name = schema.name;
+        }
+    }
+    status->schema_id = copyString(session->schema);
+    status->schema_name = copyString(name);
+    status->is_disabled = False;
+    status->is_composing = !session->input.empty();
+    status->is_ascii_mode = session->options["ascii_mode"];
+    status->is_full_shape = session->options["full_shape"];
+    status->is_simplified = session->options["simplification"];
+    status->is_traditional = False;
+    status->is_ascii_punct = session->options["ascii_punct"];
+    return True;
+}
+
+Bool freeStatus(RimeStatus *status) {
+    delete[] status->schema_id;
+    delete[] status->schema_name;
+    status->schema_id = nullptr;
+    status->schema_name = nullptr;
+    return True;
+}
+
+void setOption(RimeSessionId id, const char *option, Bool value) {
+    auto *session = findSession(id);
+    if (!session) {
+        return;
+    }
+    session->options[option] = value;
+    std::string message = value ? option : std::string("!") + option;
+    notify(id, "option", message.c_str());
+}
+
+Bool getOption(RimeSessionId id, const char *option) {
+    auto *session = findSession(id);
+    if (!session) {
+        return False;
+    }
+    auto iter = session->options.find(option);
+    return iter != session->options.end() && iter->second;
+}
+
+void setProperty(RimeSessionId id, const char *property, const char *value) {
+    if (auto *session = findSession(id)) {
+        session->properties[property] = value;
+    }
+}
+
+Bool getSchemaList(RimeSchemaList *list) {
+    const size_t size = std::size(schemas);
+    list->size = size;
+    list->list = new RimeSchemaListItem[size];
+    for (size_t i = 0; i < size; i++) {
+        list->list[i].schema_id = copyString(schemas[i].id);
+        list->list[i].name = copyString(schemas[i].name);
+        list->list[i].reserved = nullptr;
+    }
+    return True;
+}
+
+void freeSchemaList(RimeSchemaList *list) {
+    for (size_t i = 0; i < list->size; i++) {
+        delete[] list->list[i].schema_id;
+        delete[] list->list[i].name;
+    }
+    delete[] list->list;
+    list->list = nullptr;
+    list->size = 0;
+}
+
+Bool selectSchema(RimeSessionId id, const char *schemaId) {
+    auto *session = findSession(id);
+    if (!session) {
+        return False;
+    }
+    session->schema = schemaId;
+    resetComposition(*session);
+    std::string message = session->schema + "/" + session->schema;
+    notify(id, "schema", message.c_str());
+    return True;
+}
+
+// Values of a config by path, list items are "<list>/@<index>".
+using MockConfig = std::map<std::string, std::string>;
+
+// Schemas only use processors known to the addon, so keys that they can't
+// handle bypass rime when nothing is composed.
+const MockConfig &schemaConfig() {
+    static const MockConfig config = []() {
+        MockConfig result;
+        const char *processors[] = {"speller", "selector", "navigator",
+                                    "express_editor"};
+        for (size_t i = 0; i < std::size(processors); i++) {
+            result["engine/processors/@" + std::to_string(i)] = processors[i];
+        }
+        result["speller/alphabet"] = "abcdefghijklmnopqrstuvwxyz";
+        return result;
+    }();
+    return config;
+}
+
+// Other configs are always empty.
+Bool configOpen(const char * /*id*/, RimeConfig *config) {
+    config->ptr = nullptr;
+    return True;
+}
+
+Bool schemaOpen(const char *schemaId, RimeConfig *config) {
+    config->ptr = nullptr;
+    for (const auto &schema : schemas) {
+        if (std::strcmp(schemaId, schema.id) == 0) {
+            config->ptr = const_cast<MockConfig *>(&schemaConfig());
+        }
+    }
+    return True;
+}
+
+Bool configClose(RimeConfig * /*config*/) { return True; }
+
+Bool configGetBool(RimeConfig * /*config*/, const char * /*key*/,
+                   Bool * /*value*/) {
+    return False;
+}
+
+const char *configGetCString(RimeConfig *config, const char *key) {
+    const auto *values = static_cast<const MockConfig *>(config->ptr);
+    if (!values) {
+        return nullptr;
+    }
+    auto iter = values->find(key);
+    return iter == values->end() ? nullptr : iter->second.c_str();
+}
+
+Bool configBeginMap(RimeConfigIterator * /*iterator*/,
+                    RimeConfig * /*config*/, const char * /*key*/) {
+    return False;
+}
+
+Bool configBeginList(RimeConfigIterator *iterator, RimeConfig *config,
+                     const char *key) {
+    const auto *values = static_cast<const MockConfig *>(config->ptr);
+    if (!values) {
+        return False;
+    }
+    const auto prefix = std::string(key) + "/@";
+    auto items = std::make_unique<std::vector<std::string>>();
+    for (const auto &[path, value] : *values) {
+        if (path.starts_with(prefix) &&
+            path.find('/', prefix.size()) == std::string::npos) {
+            items->push_back(path);
+        }
+    }
+    if (items->empty()) {
+        return False;
+    }
+    iterator->list = items.release();
+    iterator->map = nullptr;
+    iterator->index = -1;
+    iterator->key = nullptr;
+    iterator->path = nullptr;
+    return True;
+}
+
+Bool configNext(RimeConfigIterator *iterator) {
+    const auto *items =
+        static_cast<const std::vector<std::string> *>(iterator->list);
+    if (!items) {
+        return False;
+    }
+    iterator->index += 1;
+    if (static_cast<size_t>(iterator->index) >= items->size()) {
+        return False;
+    }
+    iterator->path = (*items)[iterator->index].c_str();
+    return True;
+}
+
+void configEnd(RimeConfigIterator *iterator) {
+    delete static_cast<std::vector<std::string> *>(iterator->list);
+    iterator->list = nullptr;
+}
+
+const char *getInput(RimeSessionId id) {
+    auto *session = findSession(id);
+    return session ? session->input.c_str() : nullptr;
+}
+
+Bool setInput(RimeSessionId id, const char *input) {
+    auto *session = findSession(id);
+    if (!session || !input) {
+        return False;
+    }
+    resetComposition(*session);
+    for (const char *c = input; *c; c++) {
+        if (*c >= 'a' && *c <= 'z') {
+            session->input.push_back(*c);
+        }
+    }
+    return True;
+}
+
+Bool selectCandidateGlobal(RimeSessionId id, size_t index) {
+    auto *session = findSession(id);
+    return session && selectCandidate(*session, index);
+}
+
+Bool selectCandidateOnCurrentPage(RimeSessionId id, size_t index) {
+    auto *session = findSession(id);
+    return session && index < pageLength(*session) &&
+           selectCandidate(*session, pageStart(*session) + index);
+}
+
+struct CandidateIterator {
+    std::vector<std::pair<std::string, std::string>> candidates;
+};
+
+Bool candidateListFromIndex(RimeSessionId id,
+                            RimeCandidateListIterator *iterator, int index) {
+    auto *session = findSession(id);
+    if (!session || session->input.empty()) {
+        return False;
+    }
+    auto *candidates = new CandidateIterator;
+    for (size_t i = 0; i < state().numCandidates; i++) {
+        candidates->candidates.emplace_back(candidateText(*session, i),
+                                            candidateComment(i));
+    }
+    iterator->ptr = candidates;
+    iterator->index = index - 1;
+    return True;
+}
+
+Bool candidateListBegin(RimeSessionId id,
+                        RimeCandidateListIterator *iterator) {
+    return candidateListFromIndex(id, iterator, 0);
+}
+
+Bool candidateListNext(RimeCandidateListIterator *iterator) {
+    auto *candidates = static_cast<CandidateIterator *>(iterator->ptr);
+    if (!candidates) {
+        return False;
+    }
+    iterator->index += 1;
+    if (iterator->index < 0 ||
+        static_cast<size_t>(iterator->index) >= candidates->candidates.size()) {
+        return False;
+    }
+    auto &[text, comment] = candidates->candidates[iterator->index];
+    iterator->candidate.text = text.data();
+    iterator->candidate.comment = comment.empty() ? nullptr : comment.data();
+    iterator->candidate.reserved = nullptr;
+    return True;
+}
+
+void candidateListEnd(RimeCandidateListIterator *iterator) {
+    delete static_cast<CandidateIterator *>(iterator->ptr);
+    iterator->ptr = nullptr;
+}
+
+Bool deleteCandidate(RimeSessionId id, size_t index) {
+    auto *session = findSession(id);
+    return session && !session->input.empty() &&
+           index < state().numCandidates;
+}
+
+Bool deleteCandidateOnCurrentPage(RimeSessionId id, size_t index) {
+    auto *session = findSession(id);
+    return session && index < pageLength(*session);
+}
+
+RimeStringSlice getStateLabelAbbreviated(RimeSessionId /*id*/,
+                                         const char * /*option*/,
+                                         Bool /*state*/, Bool /*abbrev*/) {
+    return {nullptr, 0};
+}
+
+#ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
+Bool highlightCandidate(RimeSessionId id, size_t index) {
+    auto *session = findSession(id);
+    if (!session || session->input.empty() ||
+        index >= state().numCandidates) {
+        return False;
+    }
+    session->page = index / state().pageSize;
+    session->highlighted = index % state().pageSize;
+    return True;
+}
+#endif
+
+#ifndef FCITX_RIME_NO_CHANGE_PAGE
+Bool changePageOfSession(RimeSessionId id, Bool backward) {
+    auto *session = findSession(id);
+    if (!session || session->input.empty()) {
+        return False;
+    }
+    changePage(*session, backward);
+    return True;
+}
+#endif
+
+const char *getVersion() { return "0.0.0-mock"; }
+
+rime_api_t *mockApi() {
+    static rime_api_t api = []() {
+        rime_api_t result{};
+        RIME_STRUCT_INIT(rime_api_t, result);
+        result.setup = &setup;
+        result.set_notification_handler = &setNotificationHandler;
+        result.initialize = &initialize;
+        result.finalize = &finalize;
+        result.start_maintenance = &startMaintenance;
+        result.is_maintenance_mode = &isMaintenanceMode;
+        result.deploy_config_file = &deployConfigFile;
+        result.sync_user_data = &syncUserData;
+        result.create_session = &createSession;
+        result.find_session = &sessionExists;
+        result.destroy_session = &destroySession;
+        result.process_key = &processKey;
+        result.clear_composition = &clearComposition;
+        result.get_commit = &getCommit;
+        result.free_commit = &freeCommit;
+        result.get_context = &getContext;
+        result.free_context = &freeContext;
+        result.get_status = &getStatus;
+        result.free_status = &freeStatus;
+        result.candidate_list_begin = &candidateListBegin;
+        result.candidate_list_next = &candidateListNext;
+        result.candidate_list_end = &candidateListEnd;
+        result.set_option = &setOption;
+        result.get_option = &getOption;
+        result.set_property = &setProperty;
+        result.get_schema_list = &getSchemaList;
+        result.free_schema_list = &freeSchemaList;
+        result.select_schema = &selectSchema;
+        result.schema_open = &schemaOpen;
+        result.config_open = &configOpen;
+        result.config_close = &configClose;
+        result.config_get_bool = &configGetBool;
+        result.config_get_cstring = &configGetCString;
+        result.config_begin_map = &configBeginMap;
+        result.config_begin_list = &configBeginList;
+        result.config_next = &configNext;
+        result.config_end = &configEnd;
+        result.get_input = &getInput;
+        result.set_input = &setInput;
+        result.select_candidate = &selectCandidateGlobal;
+        result.select_candidate_on_current_page = &selectCandidateOnCurrentPage;
+        result.candidate_list_from_index = &candidateListFromIndex;
+        result.get_version = &getVersion;
+        result.delete_candidate = &deleteCandidate;
+        result.delete_candidate_on_current_page = &deleteCandidateOnCurrentPage;
+        result.get_state_label_abbreviated = &getStateLabelAbbreviated;
+#ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
+        result.highlight_candidate = &highlightCandidate;
+#endif
+#ifndef FCITX_RIME_NO_CHANGE_PAGE
+        result.change_page = &changePageOfSession;
+#endif
+        return result;
+    }();
+    return &api;
+}
+
+} // namespace
+
+extern "C" __attribute__((visibility("default"))) rime_api_t *rime_get_api() {
+    return mockApi();
+}
@@ -0,0 +1,613 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// Counts heap allocations per key in steady state, split between the addon
+// and librime, and checks them against a budget.
+//
+// Keys are passed to the keyEvent of the addon directly, and the allocations
+// made on the main thread until it returns are counted as the addon's, unless
+// they happen inside a call to librime. The rime api table is patched to know
+// the latter. Keys are expected to be processed synchronously, i.e. without
+// AsyncKeyProcessing.
+//
+// With glibc, malloc is replaced as well as operator new, so allocations from
+// C code are also counted. Otherwise only operator new is counted.
+//
+// The budget file has one "<scenario> <allocations> <bytes>" line per
+// scenario, as the maximum allowed addon allocations and bytes per key.
+// --record writes the current numbers in the same format, raised by
+// --margin percent. A scenario without a budget is reported and the exit
+// code is 77, which the test treats as skipped, so a budget is never
+// made up.
+
+#include "benchcommon.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx-utils/stringutils.h>
+#include <fcitx/event.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodengine.h>
+#include <fcitx/inputmethodentry.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/instance.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <optional>
+#include <rime_api.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum class AllocSide { None, Addon, Librime };
+
+struct AllocCounter {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Only trivially initialized thread locals, operator new may run before
+// anything else.
+thread_local AllocSide currentSide = AllocSide::None;
+thread_local AllocCounter counters[3];
+
+void countAllocation(size_t size) {
+    if (currentSide != AllocSide::None) {
+        auto &counter = counters[static_cast<size_t>(currentSide)];
+        counter.count += 1;
+        counter.bytes += size;
+    }
+}
+
+void *allocate(size_t size, size_t alignment = 0) {
+#ifndef __GLIBC__
+    // Otherwise malloc counts by itself.
+    countAllocation(size);
+#endif
+    void *ptr = nullptr;
+    if (alignment > alignof(std::max_align_t)) {
+        if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) {
+            ptr = nullptr;
+        }
+    } else {
+        ptr = std::malloc(size ? size : 1);
+    }
+    return ptr;
+}
+
+void *allocateOrThrow(size_t size, size_t alignment = 0) {
+    if (void *ptr = allocate(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Switch the side that allocations are counted to, if counting.
+class AllocScope {
+public:
+    explicit AllocScope(AllocSide side) : previous_(currentSide) {
+        if (previous_ != AllocSide::None) {
+            currentSide = side;
+        }
+    }
+    ~AllocScope() { currentSide = previous_; }
+
+    AllocScope(const AllocScope &) = delete;
+    AllocScope &operator=(const AllocScope &) = delete;
+
+private:
+    AllocSide previous_;
+};
+
+template <auto Member, typename F>
+struct RimeApiWrapper;
+
+// Replace a member of rime_api_t with one that marks the librime side.
+template <auto Member, typename R, typename... Args>
+struct RimeApiWrapper<Member, R (*)(Args...)> {
+    static inline R (*original)(Args...) = nullptr;
+
+    static R call(Args... args) {
+        AllocScope scope(AllocSide::Librime);
+        return original(args...);
+    }
+
+    static void install(rime_api_t *api) {
+        if (api->*Member && api->*Member != &call) {
+            original = api->*Member;
+            api->*Member = &call;
+        }
+    }
+};
+
+using NotificationWrapper =
+    RimeApiWrapper<&rime_api_t::set_notification_handler,
+                   decltype(rime_api_t::set_notification_handler)>;
+
+RimeNotificationHandler notificationHandler = nullptr;
+
+// Notification handler is the addon's code called from librime.
+void notificationTrampoline(void *context, RimeSessionId session,
+                            const char *messageType,
+                            const char *messageValue) {
+    AllocScope scope(AllocSide::Addon);
+    notificationHandler(context, session, messageType, messageValue);
+}
+
+void setNotificationHandler(RimeNotificationHandler handler, void *context) {
+    notificationHandler = handler;
+    NotificationWrapper::original(handler ? &notificationTrampoline : nullptr,
+                                  context);
+}
+
+#define WRAP_RIME_API(api, NAME)                                               \
+    RimeApiWrapper<&rime_api_t::NAME, decltype(rime_api_t::NAME)>::install(api)
+
+void wrapRimeApi(rime_api_t *api) {
+    if (api->set_notification_handler != &setNotificationHandler) {
+        NotificationWrapper::original = api->set_notification_handler;
+        api->set_notification_handler = &setNotificationHandler;
+    }
+    WRAP_RIME_API(api, finalize);
+    WRAP_RIME_API(api, start_maintenance);
+    WRAP_RIME_API(api, is_maintenance_mode);
+    WRAP_RIME_API(api, deploy_config_file);
+    WRAP_RIME_API(api, sync_user_data);
+    WRAP_RIME_API(api, create_session);
+    WRAP_RIME_API(api, find_session);
+    WRAP_RIME_API(api, destroy_session);
+    WRAP_RIME_API(api, process_key);
+    WRAP_RIME_API(api, clear_composition);
+    WRAP_RIME_API(api, get_commit);
+    WRAP_RIME_API(api, free_commit);
+    WRAP_RIME_API(api, get_context);
+    WRAP_RIME_API(api, free_context);
+    WRAP_RIME_API(api, get_status);
+    WRAP_RIME_API(api, free_status);
+    WRAP_RIME_API(api, candidate_list_begin);
+    WRAP_RIME_API(api, candidate_list_next);
+    WRAP_RIME_API(api, candidate_list_end);
+    WRAP_RIME_API(api, candidate_list_from_index);
+    WRAP_RIME_API(api, set_option);
+    WRAP_RIME_API(api, get_option);
+    WRAP_RIME_API(api, set_property);
+    WRAP_RIME_API(api, get_schema_list);
+    WRAP_RIME_API(api, free_schema_list);
+    WRAP_RIME_API(api, select_schema);
+    WRAP_RIME_API(api, schema_open);
+    WRAP_RIME_API(api, config_open);
+    WRAP_RIME_API(api, config_close);
+    WRAP_RIME_API(api, config_get_bool);
+    WRAP_RIME_API(api, config_get_cstring);
+    WRAP_RIME_API(api, config_begin_map);
+    WRAP_RIME_API(api, config_begin_list);
+    WRAP_RIME_API(api, config_next);
+    WRAP_RIME_API(api, config_end);
+    WRAP_RIME_API(api, get_input);
+    WRAP_RIME_API(api, select_candidate);
+    WRAP_RIME_API(api, select_candidate_on_current_page);
+    WRAP_RIME_API(api, delete_candidate);
+    WRAP_RIME_API(api, delete_candidate_on_current_page);
+    WRAP_RIME_API(api, get_state_label_abbreviated);
+#ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
+    WRAP_RIME_API(api, highlight_candidate);
+#endif
+#ifndef FCITX_RIME_NO_CHANGE_PAGE
+    WRAP_RIME_API(api, change_page);
+#endif
+}
+
+} // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *result = memalign(alignment, size);
+    if (!result) {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+} // extern "C"
+#endif
+
+void *operator new(size_t size) { return allocateOrThrow(size); }
+void *operator new[](size_t size) { return allocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t & /*unused*/) noexcept {
+    return allocate(size);
+}
+void *operator new[](size_t size,
+                     const std::nothrow_t & /*unused*/) noexcept {
+    return allocate(size);
+}
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t & /*unused*/) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t & /*unused*/) noexcept {
+    return allocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t /*unused*/) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+void operator delete(void *ptr, size_t /*unused*/,
+                     std::align_val_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void *ptr, size_t /*unused*/,
+                       std::align_val_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using namespace fcitx;
+using namespace fcitx::rime;
+
+struct AllocOptions {
+    HeadlessOptions headless;
+    std::string budget;
+    std::string record;
+    std::string output;
+    double margin = 10;
+    int warmup = 20;
+    int iterations = 100;
+};
+
+struct Scenario {
+    const char *name;
+    std::vector<Key> keys;
+};
+
+struct ScenarioResult {
+    std::string name;
+    uint64_t keys = 0;
+    AllocCounter addon;
+    AllocCounter librime;
+    uint64_t maxAddonCount = 0;
+
+    double addonCountPerKey() const {
+        return keys ? static_cast<double>(addon.count) / keys : 0;
+    }
+    double addonBytesPerKey() const {
+        return keys ? static_cast<double>(addon.bytes) / keys : 0;
+    }
+};
+
+std::vector<Key> parseKeys(std::string_view names) {
+    std::vector<Key> result;
+    for (const auto &name : stringutils::split(names, " ")) {
+        result.emplace_back(name);
+    }
+    return result;
+}
+
+std::vector<Scenario> scenarios() {
+    return {
+        {"type", parseKeys("n i h a o space")},
+        {"edit", parseKeys("z h o n g BackSpace BackSpace n g Escape")},
+        {"page", parseKeys("n i Page_Down Page_Down Page_Up Page_Up Escape")},
+        {"passthrough", parseKeys("Left Right Home End")},
+    };
+}
+
+class RimeAlloc {
+public:
+    RimeAlloc(Instance *instance, const AllocOptions &options)
+        : rime_(instance), options_(options),
+          engine_(dynamic_cast<InputMethodEngine *>(rime_.rime())),
+          entry_(instance->inputMethodManager().entry("rime")) {
+        if (!engine_ || !entry_) {
+            throw std::runtime_error("Failed to find rime input method");
+        }
+        wrapRimeApi(rime_.api());
+        // Register the notification handler again through the wrapper.
+        rime_.rime()->reloadConfig();
+        rime_.waitForMaintenance();
+    }
+
+    void run() {
+        for (const auto &scenario : scenarios()) {
+            results_.push_back(runScenario(scenario));
+        }
+    }
+
+    static constexpr int OverBudget = 2;
+    static constexpr int NoBudget = 77;
+
+    // Return 0, OverBudget or NoBudget.
+    int check(const std::string &path) const;
+    void record(const std::string &path) const;
+    void write(std::ostream &out) const;
+
+private:
+    ScenarioResult runScenario(const Scenario &scenario) {
+        ScenarioResult result{.name = scenario.name};
+        auto *ic = rime_.createInputContext();
+        for (int i = 0; i < options_.warmup; i++) {
+            for (const auto &key : scenario.keys) {
+                keyEvent(ic, key, /*count=*/false);
+            }
+        }
+        for (int i = 0; i < options_.iterations; i++) {
+            for (const auto &key : scenario.keys) {
+                counters[static_cast<size_t>(AllocSide::Addon)] = {};
+                counters[static_cast<size_t>(AllocSide::Librime)] = {};
+                keyEvent(ic, key, /*count=*/true);
+                const auto &addon =
+                    counters[static_cast<size_t>(AllocSide::Addon)];
+                const auto &librime =
+                    counters[static_cast<size_t>(AllocSide::Librime)];
+                result.keys += 1;
+                result.addon.count += addon.count;
+                result.addon.bytes += addon.bytes;
+                result.librime.count += librime.count;
+                result.librime.bytes += librime.bytes;
+                result.maxAddonCount =
+                    std::max(result.maxAddonCount, addon.count);
+            }
+        }
+        rime_.sendKey(ic, Key(FcitxKey_Escape));
+        rime_.destroyInputContext(ic);
+        return result;
+    }
+
+    // Only the keyEvent of the addon, without the rest of fcitx that a key
+    // normally goes through.
+    void keyEvent(InputContext *ic, const Key &key, bool count) {
+        KeyEvent event(ic, key);
+        currentSide = count ? AllocSide::Addon : AllocSide::None;
+        engine_->keyEvent(*entry_, event);
+        currentSide = AllocSide::None;
+    }
+
+    HeadlessRime rime_;
+    const AllocOptions &options_;
+    InputMethodEngine *engine_;
+    const InputMethodEntry *entry_;
+    std::vector<ScenarioResult> results_;
+};
+
+int RimeAlloc::check(const std::string &path) const {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to read budget " + path);
+    }
+    std::map<std::string, std::pair<double, double>> budgets;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream stream(line);
+        std::string name;
+        double count = 0;
+        double bytes = 0;
+        if (stream >> name >> count >> bytes) {
+            budgets[name] = {count, bytes};
+        }
+    }
+
+    int ret = 0;
+    for (const auto &result : results_) {
+        auto iter = budgets.find(result.name);
+        if (iter == budgets.end()) {
+            std::cerr << result.name << ": no budget, record one with "
+                      << "--record\n";
+            if (!ret) {
+                ret = NoBudget;
+            }
+            continue;
+        }
+        const auto [count, bytes] = iter->second;
+        if (result.addonCountPerKey() > count ||
+            result.addonBytesPerKey() > bytes) {
+            std::cerr << result.name << ": " << result.addonCountPerKey()
+                      << " allocations and " << result.addonBytesPerKey()
+                      << " bytes per key, budget is " << count << " and "
+                      << bytes << '\n';
+            ret = OverBudget;
+        }
+    }
+    return ret;
+}
+
+void RimeAlloc::record(const std::string &path) const {
+    const double scale = 1 + options_.margin / 100;
+    std::ofstream out(path);
+    out << "# scenario allocations bytes, per key on the addon side\n"
+        << "# Recorded on the "
+        << (options_.headless.librime ? "librime" : "mock") << " backend with "
+        << options_.iterations << " iterations and a margin of "
+        << options_.margin << "%.\n";
+    for (const auto &result : results_) {
+        out << result.name << ' '
+            << std::ceil(result.addonCountPerKey() * scale) << ' '
+            << std::ceil(result.addonBytesPerKey() * scale) << '\n';
+    }
+}
+
+void RimeAlloc::write(std::ostream &out) const {
+    out << "{\n";
+    out << "  \"backend\": \""
+        << (options_.headless.librime ? "librime" : "mock") << "\",\n";
+    out << "  \"scenarios\": [";
+    bool first = true;
+    for (const auto &result : results_) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << result.name << "\", "
+            << "\"keys\": " << result.keys << ", "
+            << "\"addon_allocations_per_key\": " << result.addonCountPerKey()
+            << ", "
+            << "\"addon_bytes_per_key\": " << result.addonBytesPerKey()
+            << ", "
+            << "\"addon_max_allocations\": " << result.maxAddonCount << ", "
+            << "\"librime_allocations_per_key\": "
+            << (result.keys ? static_cast<double>(result.librime.count) /
+                                  result.keys
+                            : 0)
+            << ", "
+            << "\"librime_bytes_per_key\": "
+            << (result.keys ? static_cast<double>(result.librime.bytes) /
+                                  result.keys
+                            : 0)
+            << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char *argv0) {
+    std::cout << "Usage: " << argv0 << " [options]\n"
+              << "  --budget FILE           Fail if over the budget in FILE\n"
+              << "  --record FILE           Write the result as budget\n"
+              << "  --margin PERCENT        Headroom of the recorded budget\n"
+              << "  --output FILE           Write the JSON result to FILE\n"
+              << "  --warmup N              Repetitions before measuring\n"
+              << "  --iterations N          Repetitions of each scenario\n"
+              << headlessUsage;
+}
+
+std::optional<AllocOptions> parseOptions(int argc, char *argv[]) {
+    AllocOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " +
+                                            std::string(arg));
+            }
+            return argv[++i];
+        };
+        if (parseHeadlessOption(arg, value, options.headless)) {
+            continue;
+        }
+        if (arg == "--budget") {
+            options.budget = value();
+        } else if (arg == "--record") {
+            options.record = value();
+        } else if (arg == "--margin") {
+            options.margin = std::max(0.0, std::stod(value()));
+        } else if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--warmup") {
+            options.warmup = std::max(0, std::stoi(value()));
+        } else if (arg == "--iterations") {
+            options.iterations = std::max(1, std::stoi(value()));
+        } else {
+            usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::optional<AllocOptions> options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (!options) {
+        return 1;
+    }
+
+    int budget = 0;
+    int ret = runHeadless(
+        options->headless, "rime-alloc",
+        [&options, &budget](Instance *instance) {
+            RimeAlloc alloc(instance, *options);
+            alloc.run();
+            if (options->output.empty()) {
+                alloc.write(std::cout);
+            } else {
+                std::ofstream out(options->output);
+                alloc.write(out);
+            }
+            if (!options->record.empty()) {
+                alloc.record(options->record);
+            }
+            if (!options->budget.empty()) {
+                budget = alloc.check(options->budget);
+            }
+        });
+    if (ret == 0) {
+        ret = budget;
+    }
+    return ret;
+}
@@ -0,0 +1,305 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// Loads the rime addon into a headless fcitx instance with the test frontend
+// and measures the hot paths. By default librime is replaced with the mock in
+// mockrime.cpp, pass --librime to use the real one. Results are written as
+// JSON, to stdout unless --output is given.
+
+#include "benchcommon.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/candidatelist.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace fcitx;
+using namespace fcitx::rime;
+
+constexpr std::string_view pinyinSequences[] = {
+    "nihao",   "zhongguo", "shurufa", "pinyin", "women",
+    "xiexie",  "jintian",  "tianqi",  "henhao", "pengyou",
+    "diannao", "ruanjian", "shijian", "wenti",  "xuexi",
+};
+
+struct BenchOptions {
+    HeadlessOptions headless;
+    std::string output;
+    int iterations = 100;
+    int contexts = 8;
+    int deployIterations = 3;
+    int scanLimit = 1000;
+};
+
+struct BenchResult {
+    std::string name;
+    std::vector<uint64_t> samples;
+    uint64_t commits = 0;
+};
+
+class RimeBench {
+public:
+    RimeBench(Instance *instance, const BenchOptions &options)
+        : rime_(instance), options_(options) {}
+
+    void run() {
+        results_.push_back(keystroke());
+        results_.push_back(firstKey());
+        results_.push_back(candidateFromAll());
+        results_.push_back(focusSwitch());
+        auto [release, restore] = releaseAndRestore();
+        results_.push_back(std::move(release));
+        results_.push_back(std::move(restore));
+        results_.push_back(deploy());
+    }
+
+    void write(std::ostream &out) const;
+
+private:
+    // Type every sequence and select the first candidate, one sample per key.
+    BenchResult keystroke() {
+        BenchResult result{.name = "keystroke"};
+        auto *ic = rime_.createInputContext();
+        const auto commits = rime_.commits();
+        for (int i = 0; i < options_.iterations; i++) {
+            for (auto sequence : pinyinSequences) {
+                for (char c : sequence) {
+                    Key key(static_cast<KeySym>(c));
+                    result.samples.push_back(
+                        measure([&]() { rime_.sendKey(ic, key); }));
+                }
+                Key space(FcitxKey_space);
+                result.samples.push_back(
+                    measure([&]() { rime_.sendKey(ic, space); }));
+            }
+        }
+        result.commits = rime_.commits() - commits;
+        rime_.destroyInputContext(ic);
+        return result;
+    }
+
+    // The first key on a new input context, which creates the session.
+    BenchResult firstKey() {
+        BenchResult result{.name = "first_key"};
+        const Key key(FcitxKey_n);
+        for (int i = 0; i < options_.iterations; i++) {
+            auto *ic = rime_.createInputContext();
+            result.samples.push_back(
+                measure([&]() { rime_.sendKey(ic, key); }));
+            rime_.sendKey(ic, Key(FcitxKey_Escape));
+            rime_.destroyInputContext(ic);
+        }
+        return result;
+    }
+
+    // Walk the global candidate list until it ends, one sample per scan.
+    BenchResult candidateFromAll() {
+        BenchResult result{.name = "candidate_from_all"};
+        auto *ic = rime_.createInputContext();
+        rime_.type(ic, pinyinSequences[0]);
+        auto candidateList = ic->inputPanel().candidateList();
+        auto *bulk = candidateList ? candidateList->toBulk() : nullptr;
+        if (bulk) {
+            for (int i = 0; i < options_.iterations; i++) {
+                result.samples.push_back(measure([&]() {
+                    for (int index = 0; index < options_.scanLimit; index++) {
+                        try {
+                            bulk->candidateFromAll(index);
+                        } catch (const std::invalid_argument &) {
+                            break;
+                        }
+                    }
+                }));
+            }
+        }
+        rime_.sendKey(ic, Key(FcitxKey_Escape));
+        rime_.destroyInputContext(ic);
+        return result;
+    }
+
+    std::vector<InputContext *> prepareInputContexts() {
+        std::vector<InputContext *> ics;
+        for (int i = 0; i < options_.contexts; i++) {
+            auto *ic = rime_.createInputContext();
+            rime_.sendKey(ic, Key(FcitxKey_n));
+            ic->focusOut();
+            ics.push_back(ic);
+        }
+        return ics;
+    }
+
+    void destroyInputContexts(const std::vector<InputContext *> &ics) {
+        for (auto *ic : ics) {
+            rime_.destroyInputContext(ic);
+        }
+    }
+
+    // Move the focus around N input contexts that all have a session.
+    BenchResult focusSwitch() {
+        BenchResult result{.name = "focus_switch"};
+        auto ics = prepareInputContexts();
+        InputContext *focused = nullptr;
+        for (int i = 0; i < options_.iterations * options_.contexts; i++) {
+            auto *ic = ics[i % ics.size()];
+            result.samples.push_back(measure([&]() {
+                if (focused) {
+                    focused->focusOut();
+                }
+                ic->focusIn();
+            }));
+            focused = ic;
+        }
+        if (focused) {
+            focused->focusOut();
+        }
+        destroyInputContexts(ics);
+        return result;
+    }
+
+    // Reloading the config releases every session with a snapshot, the next
+    // key on each input context restores it.
+    std::pair<BenchResult, BenchResult> releaseAndRestore() {
+        BenchResult release{.name = "release_all_session"};
+        BenchResult restore{.name = "restore_session"};
+        auto ics = prepareInputContexts();
+        const Key key(FcitxKey_i);
+        for (int i = 0; i < options_.iterations; i++) {
+            release.samples.push_back(
+                measure([&]() { rime_.rime()->reloadConfig(); }));
+            rime_.waitForMaintenance();
+            for (auto *ic : ics) {
+                ic->focusIn();
+                restore.samples.push_back(
+                    measure([&]() { rime_.sendKey(ic, key); }));
+                ic->focusOut();
+            }
+        }
+        destroyInputContexts(ics);
+        return {std::move(release), std::move(restore)};
+    }
+
+    // From the deploy request until the maintenance thread finishes.
+    BenchResult deploy() {
+        BenchResult result{.name = "deploy"};
+        for (int i = 0; i < options_.deployIterations; i++) {
+            result.samples.push_back(measure([&]() {
+                rime_.rime()->setSubConfig("deploy", {});
+                rime_.waitForMaintenance();
+            }));
+        }
+        return result;
+    }
+
+    HeadlessRime rime_;
+    const BenchOptions &options_;
+    std::vector<BenchResult> results_;
+};
+
+void RimeBench::write(std::ostream &out) const {
+    out << "{\n";
+    out << "  \"backend\": \""
+        << (options_.headless.librime ? "librime" : "mock") << "\",\n";
+    out << "  \"rime_version\": \""
+        << escapeJson(rime_.api()->get_version()) << "\",\n";
+    out << "  \"iterations\": " << options_.iterations << ",\n";
+    out << "  \"contexts\": " << options_.contexts << ",\n";
+    out << "  \"benchmarks\": [";
+    bool first = true;
+    for (const auto &result : results_) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"name\": \"" << result.name << "\", ";
+        writeSamples(out, result.samples);
+        out << ", \"commits\": " << result.commits << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char *argv0) {
+    std::cout
+        << "Usage: " << argv0 << " [options]\n"
+        << "  --output FILE           Write the JSON result to FILE\n"
+        << "  --iterations N          Iterations of each benchmark\n"
+        << "  --contexts N            Input contexts for the session benches\n"
+        << "  --deploy-iterations N   Iterations of the deploy benchmark\n"
+        << "  --scan-limit N          Max candidates walked by one scan\n"
+        << headlessUsage;
+}
+
+std::optional<BenchOptions> parseOptions(int argc, char *argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " +
+                                            std::string(arg));
+            }
+            return argv[++i];
+        };
+        auto number = [&]() { return std::max(1, std::stoi(value())); };
+        if (parseHeadlessOption(arg, value, options.headless)) {
+            continue;
+        }
+        if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--iterations") {
+            options.iterations = number();
+        } else if (arg == "--contexts") {
+            options.contexts = number();
+        } else if (arg == "--deploy-iterations") {
+            options.deployIterations = number();
+        } else if (arg == "--scan-limit") {
+            options.scanLimit = number();
+        } else {
+            usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::optional<BenchOptions> options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (!options) {
+        return 1;
+    }
+
+    return runHeadless(
+        options->headless, "rime-bench", [&options](Instance *instance) {
+            RimeBench bench(instance, *options);
+            bench.run();
+            if (options->output.empty()) {
+                bench.write(std::cout);
+            } else {
+                std::ofstream out(options->output);
+                bench.write(out);
+            }
+        });
+}
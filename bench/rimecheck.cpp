@@ -0,0 +1,139 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// Checks the behavior of the addon in a headless instance, registered as a
+// test. The checks depend on how the mock in mockrime.cpp handles keys, so
+// they always run on it. Every check starts from the default config with a
+// new input context, and the exit code is the number of failed checks.
+
+#include "benchcommon.h"
+#include "rimeconverter.h"
+#include <cstddef>
+#include <exception>
+#include <fcitx-config/configuration.h>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx/addoninstance.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace fcitx;
+using namespace fcitx::rime;
+
+void expect(bool condition, const std::string &message) {
+    if (!condition) {
+        throw std::runtime_error(message);
+    }
+}
+
+class RimeCheck {
+public:
+    explicit RimeCheck(Instance *instance) : rime_(instance) {
+        rime_.rime()->getConfig()->save(defaultConfig_);
+    }
+
+    void run() {
+        check("backspace_after_first_key",
+              [this]() { backspaceAfterFirstKey(); });
+        check("flush_before_bypass", [this]() { flushBeforeBypass(); });
+        check("convert_unknown_schema", [this]() { convertUnknownSchema(); });
+    }
+
+    size_t failures() const { return failures_; }
+
+private:
+    void check(const char *name, const std::function<void()> &callback) {
+        try {
+            callback();
+            std::cout << "PASS " << name << '\n';
+        } catch (const std::exception &e) {
+            std::cout << "FAIL " << name << ": " << e.what() << '\n';
+            failures_ += 1;
+        }
+        rime_.rime()->setConfig(defaultConfig_);
+        rime_.waitForMaintenance();
+    }
+
+    void setOptions(
+        const std::vector<std::pair<std::string, std::string>> &options) {
+        RawConfig config = defaultConfig_;
+        for (const auto &[path, value] : options) {
+            config.setValueByPath(path, value);
+        }
+        rime_.rime()->setConfig(config);
+        rime_.waitForMaintenance();
+    }
+
+    // With coalescing, the panel still shows nothing composed when BackSpace
+    // follows the first key, but it must still go to rime.
+    void backspaceAfterFirstKey() {
+        auto *ic = rime_.createInputContext();
+        // Make the panel empty.
+        rime_.type(ic, "n");
+        rime_.sendKey(ic, Key(FcitxKey_Escape));
+        setOptions({{"CoalesceKeyEvents", "True"}});
+
+        expect(rime_.sendKey(ic, Key(FcitxKey_n)), "n is not handled");
+        expect(rime_.sendKey(ic, Key(FcitxKey_BackSpace)),
+               "BackSpace goes to the application while composing");
+        expect(!rime_.sendKey(ic, Key(FcitxKey_BackSpace)),
+               "BackSpace is taken with nothing composed");
+        rime_.destroyInputContext(ic);
+    }
+
+    // A key that goes to the application must not overtake the delayed
+    // update of what rime has.
+    void flushBeforeBypass() {
+        setOptions({{"UIUpdateInterval", "200"}});
+        auto *ic = rime_.createInputContext();
+        rime_.type(ic, "n");
+        expect(!ic->inputPanel().empty(), "n is not shown");
+        rime_.sendKey(ic, Key(FcitxKey_Escape));
+        expect(!rime_.sendKey(ic, Key(FcitxKey_Left)),
+               "Left is taken with nothing composed");
+        expect(ic->inputPanel().empty(),
+               "Panel is outdated when Left goes to the application");
+        rime_.destroyInputContext(ic);
+    }
+
+    // librime takes any schema id, the converter must not.
+    void convertUnknownSchema() {
+        RimeConverter converter(rime_.api());
+        expect(!converter.convert("unknown", {"ni"}, 5),
+               "Unknown schema is converted");
+        expect(converter.size() == 0, "Session is kept for unknown schema");
+        auto result = converter.convert("mock_pinyin", {"ni"}, 5);
+        expect(result && result->size() == 1,
+               "Schema in the schema list is not converted");
+    }
+
+    HeadlessRime rime_;
+    RawConfig defaultConfig_;
+    size_t failures_ = 0;
+};
+
+} // namespace
+
+int main() {
+    size_t failures = 0;
+    const int ret = runHeadless(HeadlessOptions(), "rime-check",
+                                [&failures](Instance *instance) {
+                                    RimeCheck check(instance);
+                                    check.run();
+                                    failures = check.failures();
+                                });
+    return ret ? ret : static_cast<int>(failures);
+}
@@ -0,0 +1,230 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// Replays a key trace recorded with the RecordKeys option through a headless
+// instance as fast as possible, and reports the latency of keys as JSON. The
+// committed text can be written to a file with --commits, its digest is
+// always reported, so two builds can be checked to produce the same output.
+
+#include "benchcommon.h"
+#include "rimekeytrace.h"
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fcitx-utils/key.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/instance.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using namespace fcitx;
+using namespace fcitx::rime;
+
+struct ReplayOptions {
+    HeadlessOptions headless;
+    std::string trace;
+    std::string output;
+    std::string commits;
+};
+
+class RimeReplay {
+public:
+    RimeReplay(Instance *instance, const ReplayOptions &options)
+        : rime_(instance), options_(options) {
+        if (!options_.commits.empty()) {
+            commitLog_.open(options_.commits);
+        }
+        rime_.setCommitCallback(
+            [this](InputContext *ic, const std::string &text) {
+                commit(ic, text);
+            });
+    }
+
+    void run();
+    void write(std::ostream &out) const;
+
+private:
+    InputContext *inputContext(uint32_t id, const std::string &program) {
+        auto &ic = inputContexts_[id];
+        if (!ic) {
+            ic = rime_.createInputContext(program);
+            ic->focusOut();
+            ids_[ic] = id;
+        }
+        return ic;
+    }
+
+    void commit(InputContext *ic, const std::string &text) {
+        auto iter = ids_.find(ic);
+        const auto id = iter != ids_.end() ? iter->second : UINT32_MAX;
+        if (commitLog_.is_open()) {
+            commitLog_ << id << '\t' << text << '\n';
+        }
+        // FNV-1a over the id and text of every commit.
+        auto hash = [this](const void *data, size_t size) {
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            for (size_t i = 0; i < size; i++) {
+                digest_ = (digest_ ^ bytes[i]) * 0x100000001b3ULL;
+            }
+        };
+        hash(&id, sizeof(id));
+        hash(text.data(), text.size() + 1);
+    }
+
+    HeadlessRime rime_;
+    const ReplayOptions &options_;
+    std::ofstream commitLog_;
+    std::unordered_map<uint32_t, InputContext *> inputContexts_;
+    std::unordered_map<InputContext *, uint32_t> ids_;
+    std::vector<uint64_t> press_;
+    std::vector<uint64_t> release_;
+    // Press latency by key name.
+    std::map<std::string, std::vector<uint64_t>> byKey_;
+    uint64_t accepted_ = 0;
+    uint64_t digest_ = 0xcbf29ce484222325ULL;
+};
+
+void RimeReplay::run() {
+    RimeKeyTraceReader reader;
+    if (!reader.open(options_.trace)) {
+        throw std::runtime_error("Failed to read key trace " +
+                                 options_.trace);
+    }
+    InputContext *focused = nullptr;
+    while (auto record = reader.next()) {
+        if (record->type == RimeKeyTraceRecordType::Program) {
+            inputContext(record->inputContext, record->program);
+            continue;
+        }
+        auto *ic = inputContext(record->inputContext, "");
+        if (ic != focused) {
+            if (focused) {
+                focused->focusOut();
+            }
+            ic->focusIn();
+            focused = ic;
+        }
+        bool accepted = false;
+        const auto latency = measure([&]() {
+            accepted = rime_.sendKey(ic, record->key, record->isRelease);
+        });
+        accepted_ += accepted;
+        if (record->isRelease) {
+            release_.push_back(latency);
+        } else {
+            press_.push_back(latency);
+            byKey_[Key::keySymToString(record->key.sym())].push_back(latency);
+        }
+    }
+    if (focused) {
+        focused->focusOut();
+    }
+}
+
+void RimeReplay::write(std::ostream &out) const {
+    char digest[17];
+    snprintf(digest, sizeof(digest), "%016llx",
+             static_cast<unsigned long long>(digest_));
+    out << "{\n";
+    out << "  \"trace\": \"" << escapeJson(options_.trace) << "\",\n";
+    out << "  \"backend\": \""
+        << (options_.headless.librime ? "librime" : "mock") << "\",\n";
+    out << "  \"input_contexts\": " << inputContexts_.size() << ",\n";
+    out << "  \"accepted\": " << accepted_ << ",\n";
+    out << "  \"commits\": " << rime_.commits() << ",\n";
+    out << "  \"commit_digest\": \"" << digest << "\",\n";
+    out << "  \"press\": {";
+    writeSamples(out, press_);
+    out << "},\n";
+    out << "  \"release\": {";
+    writeSamples(out, release_);
+    out << "},\n";
+    out << "  \"by_key\": [";
+    bool first = true;
+    for (const auto &[key, samples] : byKey_) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "    {\"key\": \"" << escapeJson(key) << "\", ";
+        writeSamples(out, samples);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void usage(const char *argv0) {
+    std::cout << "Usage: " << argv0 << " [options] TRACE\n"
+              << "  --output FILE           Write the JSON result to FILE\n"
+              << "  --commits FILE          Write committed text to FILE\n"
+              << headlessUsage;
+}
+
+std::optional<ReplayOptions> parseOptions(int argc, char *argv[]) {
+    ReplayOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " +
+                                            std::string(arg));
+            }
+            return argv[++i];
+        };
+        if (parseHeadlessOption(arg, value, options.headless)) {
+            continue;
+        }
+        if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--commits") {
+            options.commits = value();
+        } else if (!arg.starts_with("-") && options.trace.empty()) {
+            options.trace = arg;
+        } else {
+            usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+    if (options.trace.empty()) {
+        usage(argv[0]);
+        return std::nullopt;
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::optional<ReplayOptions> options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (!options) {
+        return 1;
+    }
+
+    return runHeadless(
+        options->headless, "rime-replay", [&options](Instance *instance) {
+            RimeReplay replay(instance, *options);
+            replay.run();
+            if (options->output.empty()) {
+                replay.write(std::cout);
+            } else {
+                std::ofstream out(options->output);
+                replay.write(out);
+            }
+        });
+}
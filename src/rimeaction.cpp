@@ -30,7 +30,7 @@ std::optional<bool> optionValue(RimeEngine *engine, InputContext *ic,
     if (!state) {
         return std::nullopt;
     }
-    auto session = state->session(requestSession);
+    auto session = state->syncSession(requestSession);
     if (!session) {
         return std::nullopt;
     }
@@ -53,7 +53,7 @@ void ToggleAction::activate(InputContext *ic) {
     if (!state) {
         return;
     }
-    auto session = state->session();
+    auto session = state->syncSession();
     Bool oldValue = api->get_option(session, option_.c_str());
     api->set_option(session, option_.c_str(), !oldValue);
 }
@@ -103,7 +103,7 @@ SelectAction::SelectAction(RimeEngine *engine, std::string_view schema,
                 if (!state) {
                     return;
                 }
-                auto session = state->session();
+                auto session = state->syncSession();
                 for (size_t j = 0; j < options_.size(); ++j) {
                     api->set_option(session, options_[j].c_str(), i == j);
                 }
@@ -125,7 +125,7 @@ std::string SelectAction::shortText(InputContext *ic) const {
     if (!state || texts_.empty()) {
         return "";
     }
-    auto session = state->session();
+    auto session = state->syncSession();
     for (size_t i = 0; i < options_.size(); ++i) {
         if (api->get_option(session, options_[i].c_str())) {
             return texts_[i];
@@ -140,7 +140,7 @@ std::optional<std::string> SelectAction::snapshotOption(InputContext *ic) {
     if (!state) {
         return std::nullopt;
     }
-    auto session = state->session(false);
+    auto session = state->syncSession(false);
     if (!session) {
         return std::nullopt;
     }
@@ -0,0 +1,51 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimeapi.h"
+#include <cstdlib>
+#include <rime_api.h>
+#include <stdexcept>
+#include <string>
+
+#ifdef FCITX_RIME_BENCH
+#include <fcitx-utils/library.h>
+#endif
+
+namespace fcitx::rime {
+
+rime_api_t *loadRimeApi() {
+    rime_api_t *api = nullptr;
+#ifdef FCITX_RIME_BENCH
+    if (const char *path = getenv("FCITX_RIME_API_LIBRARY"); path && path[0]) {
+        // Loaded once, the addon and the benchmark share the same library.
+        static Library library;
+        if (!library.loaded()) {
+            library = Library(path);
+            if (!library.load()) {
+                throw std::runtime_error("Failed to load " +
+                                         std::string(path) + ": " +
+                                         library.error());
+            }
+        }
+        auto *getApi = library.resolve("rime_get_api");
+        if (!getApi) {
+            throw std::runtime_error("Failed to resolve rime_get_api: " +
+                                     library.error());
+        }
+        api = Library::toFunction<rime_api_t *()>(getApi)();
+    } else {
+        api = rime_get_api();
+    }
+#else
+    api = rime_get_api();
+#endif
+    if (!api) {
+        throw std::runtime_error("Failed to get Rime API");
+    }
+    return api;
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEAPI_H_
+#define _FCITX_RIMEAPI_H_
+
+#include <rime_api.h>
+
+namespace fcitx::rime {
+
+// Get the api of librime, throw if it is not available.
+//
+// Only when built with benchmarks, FCITX_RIME_API_LIBRARY may name a library
+// to load it from instead, e.g. the mock librime.
+rime_api_t *loadRimeApi();
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEAPI_H_
@@ -0,0 +1,246 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimebuildcache.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// FNV-1a over the relative path, size and modification time of every file
+// under the directory, which change whenever the data is updated, without
+// reading it. Dictionaries may be in sub directories, e.g. for
+// import_tables.
+uint64_t hashDirectory(const fs::path &dir) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto update = [&hash](const char *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) *
+                   0x100000001b3ULL;
+        }
+    };
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator
+             iter(dir, fs::directory_options::skip_permission_denied, ec),
+         end;
+         !ec && iter != end; iter.increment(ec)) {
+        if (iter->is_regular_file(ec)) {
+            files.push_back(iter->path().lexically_relative(dir));
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto &file : files) {
+        const auto name = file.string();
+        update(name.c_str(), name.size() + 1);
+        struct stat st;
+        if (stat((dir / file).c_str(), &st) != 0) {
+            continue;
+        }
+        const uint64_t fields[] = {
+            static_cast<uint64_t>(st.st_size),
+            static_cast<uint64_t>(st.st_mtim.tv_sec),
+            static_cast<uint64_t>(st.st_mtim.tv_nsec)};
+        update(reinterpret_cast<const char *>(fields), sizeof(fields));
+    }
+    return hash;
+}
+
+std::string hashName(const fs::path &dir) {
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx",
+             static_cast<unsigned long long>(hashDirectory(dir)));
+    return hash;
+}
+
+bool isOwned(const struct stat &st) {
+    return st.st_uid == 0 || st.st_uid == getuid();
+}
+
+bool isTrusted(const struct stat &st) {
+    return isOwned(st) && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// The entry must not be replaced by others, so root is either not writable
+// by others or sticky. The entry itself and its files must not be writable
+// by others.
+bool isTrustedEntry(const fs::path &entry) {
+    struct stat st;
+    if (stat(entry.parent_path().c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+        !isOwned(st) ||
+        (!isTrusted(st) && !(st.st_mode & S_ISVTX))) {
+        return false;
+    }
+    if (lstat(entry.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+        !isTrusted(st)) {
+        return false;
+    }
+    std::error_code ec;
+    for (const auto &file : fs::directory_iterator(entry, ec)) {
+        if (lstat(file.path().c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+            !isTrusted(st)) {
+            return false;
+        }
+    }
+    return !ec;
+}
+
+// Name of a dictionary or schema before the first dot.
+std::string resourceName(const fs::path &file) {
+    auto name = file.filename().string();
+    return name.substr(0, name.find('.'));
+}
+
+bool isSharedResource(const fs::path &sharedDataDir,
+                      const fs::path &userDataDir, const std::string &name) {
+    std::error_code ec;
+    for (const auto *suffix : {".dict.yaml", ".schema.yaml"}) {
+        const auto file = name + suffix;
+        // Overridden by user.
+        if (fs::exists(userDataDir / file, ec)) {
+            return false;
+        }
+        if (fs::exists(sharedDataDir / file, ec)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+RimeBuildCache::RimeBuildCache(const fs::path &root,
+                               const fs::path &sharedDataDir,
+                               const fs::path &userDataDir,
+                               std::string_view version)
+    : root_(root), sharedDataDir_(sharedDataDir), userDataDir_(userDataDir),
+      link_(userDataDir / "shared_build"), version_(version) {
+    std::error_code ec;
+    enabled_ =
+        !root.empty() && !fs::is_directory(sharedDataDir / "build", ec);
+}
+
+RimeBuildCache::~RimeBuildCache() { cancel(); }
+
+void RimeBuildCache::cancel() {
+    if (!preparing_) {
+        return;
+    }
+    // Waits at most for the link update and done of a running thread.
+    std::lock_guard lock(preparing_->mutex);
+    preparing_->cancelled = true;
+    preparing_.reset();
+}
+
+fs::path RimeBuildCache::directory() const {
+    auto result = directoryPrefix();
+    result += hashName(sharedDataDir_);
+    return result;
+}
+
+fs::path RimeBuildCache::directoryPrefix() const {
+    return root_ / (version_ + "-");
+}
+
+void RimeBuildCache::prepare(std::function<void(bool)> done) {
+    cancel();
+    preparing_ = std::make_shared<Preparing>();
+    // The thread is detached with its own copy of everything, so nobody
+    // waits for it.
+    std::thread([preparing = preparing_, entry = directoryPrefix(),
+                 sharedDataDir = sharedDataDir_, link = link_,
+                 done = std::move(done)]() mutable {
+        entry += hashName(sharedDataDir);
+        const bool trusted = isTrustedEntry(entry);
+        std::lock_guard lock(preparing->mutex);
+        if (preparing->cancelled) {
+            return;
+        }
+        std::error_code ec;
+        if (trusted) {
+            // Replace the link atomically, librime may be reading it.
+            auto temp = link;
+            temp += ".tmp";
+            fs::remove(temp, ec);
+            fs::create_directory_symlink(fs::absolute(entry, ec), temp, ec);
+            if (!ec) {
+                fs::rename(temp, link, ec);
+            }
+        } else {
+            fs::remove(link, ec);
+        }
+        done(trusted && !ec);
+    }).detach();
+}
+
+bool RimeBuildCache::publish() const {
+    if (!enabled()) {
+        return false;
+    }
+    const auto entry = directory();
+    std::error_code ec;
+    if (fs::is_directory(entry, ec)) {
+        return true;
+    }
+    fs::create_directories(root_, ec);
+    const auto temp = root_ / (".tmp-" + entry.filename().string() + "-" +
+                               std::to_string(getpid()));
+    fs::remove_all(temp, ec);
+    if (!fs::create_directories(temp, ec)) {
+        return false;
+    }
+    size_t copied = 0;
+    for (const auto &file :
+         fs::directory_iterator(userDataDir_ / "build", ec)) {
+        const auto &path = file.path();
+        if (path.extension() != ".bin" || !file.is_regular_file(ec) ||
+            !isSharedResource(sharedDataDir_, userDataDir_,
+                              resourceName(path))) {
+            continue;
+        }
+        if (!fs::copy_file(path, temp / path.filename(), ec)) {
+            fs::remove_all(temp, ec);
+            return false;
+        }
+        fs::permissions(temp / path.filename(),
+                        fs::perms::owner_read | fs::perms::group_read |
+                            fs::perms::others_read,
+                        ec);
+        copied += 1;
+    }
+    fs::permissions(temp,
+                    fs::perms::owner_all | fs::perms::group_read |
+                        fs::perms::group_exec | fs::perms::others_read |
+                        fs::perms::others_exec,
+                    ec);
+    if (copied) {
+        fs::rename(temp, entry, ec);
+    }
+    if (!copied || ec) {
+        fs::remove_all(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace fcitx::rime
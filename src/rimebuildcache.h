@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEBUILDCACHE_H_
+#define _FCITX_RIMEBUILDCACHE_H_
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace fcitx::rime {
+
+// A directory shared by all users of a host, that holds the dictionaries
+// compiled from shared data. Each build lives in a sub directory named after
+// the librime version and a hash of the shared data.
+//
+// Entries are only published by an administrator, with fcitx5-rime-convert
+// --publish-build-cache run as root after the shared data is installed or
+// updated; the addon never publishes. Users only use an entry whose
+// directory and files are owned by root or themselves and not writable by
+// others, in a root that others can't rename entries in, so names that are
+// easy to guess can't be taken over. The entry is given to librime through a
+// link in the user directory, which is updated in a thread, since finding
+// the entry stats all of the shared data.
+//
+// The hash covers the names, sizes and modification times of the files, so
+// an update of the shared data gives a new entry.
+//
+// librime checks the checksums of prebuilt files, so a file that doesn't
+// match the schema of a user is ignored and built into the user directory.
+class RimeBuildCache {
+public:
+    // Empty root disables the cache. It is also disabled if shared data
+    // comes with its own prebuilt directory.
+    RimeBuildCache(const std::filesystem::path &root,
+                   const std::filesystem::path &sharedDataDir,
+                   const std::filesystem::path &userDataDir,
+                   std::string_view version);
+    ~RimeBuildCache();
+
+    bool enabled() const { return enabled_; }
+    // The prebuilt data directory to use with librime.
+    const std::filesystem::path &link() const { return link_; }
+
+    // Point link to the entry of current shared data if it is trusted, or
+    // remove it otherwise. It runs in a thread, and calls done from there,
+    // unless the cache is destroyed or prepared again before.
+    void prepare(std::function<void(bool)> done);
+
+    // Copy the files built from shared data in the user build directory to
+    // the cache. It's done in a temporary directory that is renamed in
+    // place, so others never see a partial build.
+    bool publish() const;
+
+private:
+    struct Preparing {
+        std::mutex mutex;
+        bool cancelled = false;
+    };
+
+    std::filesystem::path directory() const;
+    // Directory without the hash.
+    std::filesystem::path directoryPrefix() const;
+    void cancel();
+
+    std::filesystem::path root_;
+    std::filesystem::path sharedDataDir_;
+    std::filesystem::path userDataDir_;
+    std::filesystem::path link_;
+    std::string version_;
+    bool enabled_ = false;
+    std::shared_ptr<Preparing> preparing_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEBUILDCACHE_H_
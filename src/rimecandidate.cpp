@@ -6,12 +6,14 @@
 
 #include "rimecandidate.h"
 #include "rimeengine.h"
-#include <cstring>
 #include <fcitx-utils/log.h>
 #include <fcitx/candidatelist.h>
+#include <fcitx/text.h>
 #include <memory>
 #include <rime_api.h>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace fcitx::rime {
 
@@ -58,36 +60,25 @@ void RimeGlobalCandidateWord::forget(RimeState *state) const {
 #endif
 }
 
-RimeCandidateList::RimeCandidateList(RimeEngine *engine, InputContext *ic,
-                                     const RimeContext &context)
-    : engine_(engine), ic_(ic), hasPrev_(context.menu.page_no != 0),
+RimeCandidateList::RimeCandidateList(
+    RimeEngine *engine, InputContext *ic, const RimeContext &context,
+    std::shared_ptr<const std::vector<Text>> labels, bool bulk)
+    : engine_(engine), ic_(ic), labels_(std::move(labels)),
+      hasPrev_(context.menu.page_no != 0),
       hasNext_(!context.menu.is_last_page) {
     setPageable(this);
-    setBulk(this);
     setActionable(this);
+    if (bulk) {
+        setBulk(this);
 #ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
-    setBulkCursor(this);
+        setBulkCursor(this);
 #endif
+    }
 
     const auto &menu = context.menu;
 
-    int num_select_keys = menu.select_keys ? strlen(menu.select_keys) : 0;
-    bool has_label = RIME_STRUCT_HAS_MEMBER(context, context.select_labels) &&
-                     context.select_labels;
-
-    int i;
-    for (i = 0; i < menu.num_candidates; ++i) {
-        std::string label;
-        if (i < menu.page_size && has_label) {
-            label = context.select_labels[i];
-        } else if (i < num_select_keys) {
-            label = std::string(1, menu.select_keys[i]);
-        } else {
-            label = std::to_string((i + 1) % 10);
-        }
-        label.append(" ");
-        labels_.emplace_back(label);
-
+    candidateWords_.reserve(menu.num_candidates);
+    for (int i = 0; i < menu.num_candidates; ++i) {
         candidateWords_.emplace_back(
             std::make_unique<RimeCandidateWord>(engine, menu.candidates[i], i));
 
@@ -102,16 +93,7 @@ const CandidateWord &RimeCandidateList::candidateFromAll(int idx) const {
         throw std::invalid_argument("Invalid global index");
     }
 
-    auto session = engine_->state(ic_)->session(false);
-    if (!session) {
-        throw std::invalid_argument("Invalid session");
-    }
-
     auto index = static_cast<size_t>(idx);
-
-    auto *api = engine_->api();
-
-    RimeCandidateListIterator iter;
     if (index >= globalCandidateWords_.size()) {
         if (index >= maxSize_) {
             throw std::invalid_argument("Invalid global index");
@@ -122,6 +104,19 @@ const CandidateWord &RimeCandidateList::candidateFromAll(int idx) const {
         }
     }
 
+    auto session = engine_->state(ic_)->session(false);
+    if (!session) {
+        throw std::invalid_argument("Invalid session");
+    }
+    // Running the callbacks of keys in flight here may replace this list, so
+    // only wait for the worker. Candidates of a newer key may be returned,
+    // but the list is going to be replaced with them soon.
+    engine_->worker().wait();
+
+    auto *api = engine_->api();
+
+    RimeCandidateListIterator iter;
+
     if (!api->candidate_list_from_index(session, &iter, idx) ||
         !api->candidate_list_next(&iter)) {
         maxSize_ = std::min(index, maxSize_);
@@ -134,6 +129,7 @@ const CandidateWord &RimeCandidateList::candidateFromAll(int idx) const {
     globalCandidateWords_[index] =
         std::make_unique<RimeGlobalCandidateWord>(engine_, iter.candidate, idx);
     api->candidate_list_end(&iter);
+    engine_->metrics().recordGlobalCandidate();
     return *globalCandidateWords_[index];
 }
 
@@ -181,12 +177,9 @@ int RimeCandidateList::globalCursorIndex() const {
 }
 
 void RimeCandidateList::setGlobalCursorIndex(int index) {
-    auto session = engine_->state(ic_)->session(false);
-    if (!session) {
-        return;
+    if (auto *state = engine_->state(ic_)) {
+        state->highlightCandidate(index);
     }
-    auto *api = engine_->api();
-    api->highlight_candidate(session, index);
 }
 #endif
 } // namespace fcitx::rime
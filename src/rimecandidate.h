@@ -52,12 +52,15 @@ class RimeCandidateList final : public CandidateList,
 #endif
 {
 public:
+    // Candidates beyond current page are not exposed if bulk is false.
     RimeCandidateList(RimeEngine *engine, InputContext *ic,
-                      const RimeContext &context);
+                      const RimeContext &context,
+                      std::shared_ptr<const std::vector<Text>> labels,
+                      bool bulk = true);
 
     const Text &label(int idx) const override {
         checkIndex(idx);
-        return labels_[idx];
+        return (*labels_)[idx];
     }
 
     const CandidateWord &candidate(int idx) const override {
@@ -73,15 +76,13 @@ public:
     bool hasPrev() const override { return hasPrev_; }
     bool hasNext() const override { return hasNext_; }
     void prev() override {
-        KeyEvent event(ic_, Key(FcitxKey_Page_Up));
-        if (auto state = engine_->state(ic_)) {
-            state->keyEvent(event);
+        if (auto *state = engine_->state(ic_)) {
+            state->changePage(/*backward=*/true);
         }
     }
     void next() override {
-        KeyEvent event(ic_, Key(FcitxKey_Page_Down));
-        if (auto state = engine_->state(ic_)) {
-            state->keyEvent(event);
+        if (auto *state = engine_->state(ic_)) {
+            state->changePage(/*backward=*/false);
         }
     }
 
@@ -109,7 +110,8 @@ private:
 
     RimeEngine *engine_;
     InputContext *ic_;
-    std::vector<Text> labels_;
+    // Shared with other lists, has at least size() labels.
+    std::shared_ptr<const std::vector<Text>> labels_;
     bool hasPrev_ = false;
     bool hasNext_ = false;
     CandidateLayoutHint layout_ = CandidateLayoutHint::NotSet;
@@ -0,0 +1,360 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+// fcitx5-rime-convert converts every line of a file with a schema, and writes
+// one line for each of them: the input followed by its candidates, separated
+// by tab.
+//
+// librime can't be used from multiple threads, so the lines are converted by
+// a number of worker processes. The data is deployed once before forking, and
+// every worker loads it as prebuilt data with an empty user directory of its
+// own. So the result does not depend on the user dictionary, and workers
+// don't contend for its lock. Worker k converts the lines whose index modulo
+// the number of workers is k, and the output is read back from the workers in
+// the same order.
+//
+// With --publish-build-cache, it only deploys and publishes the build of
+// shared data to the cache that SharedBuildCache of the addon points to. It
+// is meant to be run by root, since users only trust entries of root.
+
+#include "rimebuildcache.h"
+#include "rimeconverter.h"
+#include "rimetraits.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/standardpaths.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <rime_api.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using namespace fcitx;
+using namespace fcitx::rime;
+
+constexpr size_t BatchSize = 256;
+
+struct ConvertOptions {
+    std::string input;
+    std::string output;
+    std::string schema;
+    std::string userDir;
+    std::string sharedDir = RIME_DATA_DIR;
+    std::string buildCache;
+    size_t jobs = std::max(1U, std::thread::hardware_concurrency());
+    size_t limit = 1;
+};
+
+void writeField(std::FILE *file, std::string_view field) {
+    for (char c : field) {
+        // Keep one line per input.
+        std::fputc(c == '\t' || c == '\n' ? ' ' : c, file);
+    }
+}
+
+bool deploy(rime_api_t *api, const ConvertOptions &options) {
+    RIME_STRUCT(RimeTraits, traits);
+    fillRimeTraits(traits, options.sharedDir.c_str(), options.userDir.c_str(),
+                   LogLevel::Warn);
+    api->setup(&traits);
+    api->initialize(&traits);
+    if (api->start_maintenance(false)) {
+        api->join_maintenance_thread();
+    }
+    api->finalize();
+    return std::filesystem::is_directory(
+        std::filesystem::path(options.userDir) / "build");
+}
+
+int work(rime_api_t *api, const ConvertOptions &options, size_t index,
+         std::FILE *out) {
+    std::ifstream in(options.input);
+    if (!in) {
+        std::cerr << "Failed to open " << options.input << '\n';
+        return 1;
+    }
+    std::error_code ec;
+    auto tempTemplate = (std::filesystem::temp_directory_path(ec) /
+                         "fcitx5-rime-convert-XXXXXX")
+                            .string();
+    if (!mkdtemp(tempTemplate.data())) {
+        std::cerr << "Failed to create temporary directory " << tempTemplate
+                  << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    const std::filesystem::path tempDir = tempTemplate;
+    const auto prebuiltDir =
+        (std::filesystem::path(options.userDir) / "build").string();
+    RIME_STRUCT(RimeTraits, traits);
+    fillRimeTraits(traits, options.sharedDir.c_str(), tempDir.c_str(),
+                   LogLevel::Warn);
+    traits.prebuilt_data_dir = prebuiltDir.c_str();
+    api->initialize(&traits);
+
+    int ret = 0;
+    {
+        RimeConverter converter(api);
+        std::vector<std::string> batch;
+        auto flush = [&]() {
+            auto result = converter.convert(options.schema, batch,
+                                            options.limit);
+            if (!result) {
+                return false;
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                writeField(out, batch[i]);
+                for (const auto &candidate : (*result)[i]) {
+                    std::fputc('\t', out);
+                    writeField(out, candidate);
+                }
+                std::fputc('\n', out);
+            }
+            batch.clear();
+            return true;
+        };
+        std::string line;
+        for (size_t i = 0; std::getline(in, line); i++) {
+            if (i % options.jobs != index) {
+                continue;
+            }
+            batch.push_back(std::move(line));
+            if (batch.size() >= BatchSize && !flush()) {
+                ret = 1;
+                break;
+            }
+        }
+        if (!ret && !batch.empty() && !flush()) {
+            ret = 1;
+        }
+        if (ret) {
+            std::cerr << "Failed to create a session with schema "
+                      << options.schema << '\n';
+        }
+    }
+    api->finalize();
+    std::filesystem::remove_all(tempDir, ec);
+    return ret;
+}
+
+int publish(const ConvertOptions &options) {
+    auto *api = rime_get_api();
+    if (!deploy(api, options)) {
+        std::cerr << "Failed to deploy " << options.userDir << '\n';
+        return 1;
+    }
+    const char *version = api->get_version ? api->get_version() : nullptr;
+    RimeBuildCache cache(options.buildCache, options.sharedDir,
+                         options.userDir, version ? version : "");
+    if (!cache.enabled()) {
+        std::cerr << options.sharedDir << " has its own build directory\n";
+        return 1;
+    }
+    if (!cache.publish()) {
+        std::cerr << "Failed to publish to " << options.buildCache << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int run(const ConvertOptions &options) {
+    if (!options.buildCache.empty()) {
+        return publish(options);
+    }
+    if (!std::ifstream(options.input)) {
+        std::cerr << "Failed to open " << options.input << '\n';
+        return 1;
+    }
+    auto *api = rime_get_api();
+    if (!deploy(api, options)) {
+        std::cerr << "Failed to deploy " << options.userDir << '\n';
+        return 1;
+    }
+
+    std::FILE *out = stdout;
+    if (!options.output.empty()) {
+        out = std::fopen(options.output.c_str(), "w");
+        if (!out) {
+            std::cerr << "Failed to open " << options.output << '\n';
+            return 1;
+        }
+    }
+
+    // librime is finalized and has no thread running, so it is safe to fork.
+    std::fflush(nullptr);
+    std::vector<pid_t> workers;
+    std::vector<std::FILE *> results;
+    for (size_t i = 0; i < options.jobs; i++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            std::cerr << "Failed to create pipe: " << std::strerror(errno)
+                      << '\n';
+            break;
+        }
+        const pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (auto *result : results) {
+                std::fclose(result);
+            }
+            auto *file = fdopen(fds[1], "w");
+            const int ret = work(api, options, i, file);
+            std::fclose(file);
+            _exit(ret);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            std::cerr << "Failed to start worker: " << std::strerror(errno)
+                      << '\n';
+            close(fds[0]);
+            break;
+        }
+        workers.push_back(pid);
+        results.push_back(fdopen(fds[0], "r"));
+    }
+
+    int ret = workers.size() == options.jobs ? 0 : 1;
+    if (!ret) {
+        char *line = nullptr;
+        size_t size = 0;
+        for (size_t i = 0;; i++) {
+            auto *result = results[i % options.jobs];
+            const auto length = getline(&line, &size, result);
+            if (length <= 0) {
+                break;
+            }
+            std::fwrite(line, 1, length, out);
+        }
+        std::free(line);
+    }
+    for (auto *result : results) {
+        std::fclose(result);
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        int status = 0;
+        if (waitpid(workers[i], &status, 0) < 0 || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            // Worker reports its own error if it exits normally.
+            if (!WIFEXITED(status)) {
+                std::cerr << "Worker " << i << " was terminated\n";
+            }
+            ret = 1;
+        }
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    } else {
+        std::fflush(out);
+    }
+    return ret;
+}
+
+void usage(const char *argv0) {
+    std::cout << "Usage: " << argv0 << " [options] --schema SCHEMA INPUT\n"
+              << "       " << argv0
+              << " --user-dir DIR --publish-build-cache CACHE\n"
+              << "  --schema SCHEMA         Convert with SCHEMA\n"
+              << "  --jobs N                Number of worker processes\n"
+              << "  --limit N               Candidates for each line, "
+                 "default 1\n"
+              << "  --output FILE           Write the result to FILE\n"
+              << "  --user-dir DIR          Rime user directory, default to "
+                 "the one of fcitx5,\n"
+              << "                          which must not be in use\n"
+              << "  --shared-dir DIR        Rime shared data directory\n"
+              << "  --publish-build-cache CACHE\n"
+              << "                          Publish the build of shared data "
+                 "to CACHE\n";
+}
+
+std::optional<ConvertOptions> parseOptions(int argc, char *argv[]) {
+    ConvertOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " +
+                                            std::string(arg));
+            }
+            return argv[++i];
+        };
+        if (arg == "--schema") {
+            options.schema = value();
+        } else if (arg == "--jobs") {
+            options.jobs = std::max(1UL, std::stoul(value()));
+        } else if (arg == "--limit") {
+            options.limit = std::stoul(value());
+        } else if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--user-dir") {
+            options.userDir = value();
+        } else if (arg == "--shared-dir") {
+            options.sharedDir = value();
+        } else if (arg == "--publish-build-cache") {
+            options.buildCache = value();
+        } else if (!arg.starts_with("-") && options.input.empty()) {
+            options.input = arg;
+        } else {
+            usage(argv[0]);
+            return std::nullopt;
+        }
+    }
+    if (!options.buildCache.empty()) {
+        // The build must not contain any customization of a user.
+        if (options.userDir.empty()) {
+            usage(argv[0]);
+            return std::nullopt;
+        }
+        return options;
+    }
+    if (options.input.empty() || options.schema.empty()) {
+        usage(argv[0]);
+        return std::nullopt;
+    }
+    if (options.userDir.empty()) {
+        options.userDir = (StandardPaths::global().userDirectory(
+                               StandardPathsType::PkgData) /
+                           "rime")
+                              .string();
+        // Deploying races with a running fcitx5 that uses the same directory.
+        std::cerr << "Warning: deploying to " << options.userDir
+                  << ", which is used by fcitx5. Stop fcitx5 or pass "
+                     "--user-dir to use a copy.\n";
+    }
+    return options;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::optional<ConvertOptions> options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (!options) {
+        return 1;
+    }
+    return run(*options);
+}
@@ -0,0 +1,115 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimeconverter.h"
+#include <cstddef>
+#include <optional>
+#include <rime_api.h>
+#include <string>
+#include <vector>
+
+namespace fcitx::rime {
+
+std::optional<std::vector<std::vector<std::string>>>
+RimeConverter::convert(const std::string &schema,
+                       const std::vector<std::string> &inputs, size_t limit) {
+    auto session = this->session(schema);
+    if (!session) {
+        return std::nullopt;
+    }
+    std::vector<std::vector<std::string>> result;
+    result.reserve(inputs.size());
+    for (const auto &input : inputs) {
+        result.push_back(candidates(session, input, limit));
+    }
+    return result;
+}
+
+void RimeConverter::clear() {
+    for (const auto &[schema, session] : sessions_) {
+        api_->destroy_session(session);
+    }
+    sessions_.clear();
+}
+
+RimeSessionId RimeConverter::session(const std::string &schema) {
+    for (auto iter = sessions_.begin(); iter != sessions_.end(); ++iter) {
+        if (iter->first != schema) {
+            continue;
+        }
+        // Sessions are gone if librime is restarted behind us.
+        if (!api_->find_session(iter->second)) {
+            sessions_.erase(iter);
+            break;
+        }
+        sessions_.splice(sessions_.begin(), sessions_, iter);
+        return iter->second;
+    }
+
+    // select_schema takes any id, and a session with an unknown schema
+    // would just give no candidates.
+    if (!deployed(schema)) {
+        return 0;
+    }
+    auto session = api_->create_session();
+    if (!session) {
+        return 0;
+    }
+    if (!api_->select_schema(session, schema.c_str())) {
+        api_->destroy_session(session);
+        return 0;
+    }
+    api_->set_option(session, "ascii_mode", False);
+    if (sessions_.size() >= MaxSessions) {
+        api_->destroy_session(sessions_.back().second);
+        sessions_.pop_back();
+    }
+    sessions_.emplace_front(schema, session);
+    return session;
+}
+
+bool RimeConverter::deployed(const std::string &schema) {
+    RimeSchemaList list{};
+    if (!api_->get_schema_list(&list)) {
+        return false;
+    }
+    bool found = false;
+    for (size_t i = 0; i < list.size; i++) {
+        if (list.list[i].schema_id && schema == list.list[i].schema_id) {
+            found = true;
+            break;
+        }
+    }
+    api_->free_schema_list(&list);
+    return found;
+}
+
+std::vector<std::string> RimeConverter::candidates(RimeSessionId session,
+                                                   const std::string &input,
+                                                   size_t limit) {
+    std::vector<std::string> result;
+    api_->clear_composition(session);
+    if (RIME_API_AVAILABLE(api_, set_input)) {
+        api_->set_input(session, input.c_str());
+    } else {
+        for (unsigned char c : input) {
+            api_->process_key(session, c, 0);
+        }
+    }
+
+    RimeCandidateListIterator iter{};
+    if (limit && api_->candidate_list_begin(session, &iter)) {
+        while (result.size() < limit && api_->candidate_list_next(&iter)) {
+            result.emplace_back(iter.candidate.text ? iter.candidate.text
+                                                    : "");
+        }
+        api_->candidate_list_end(&iter);
+    }
+    api_->clear_composition(session);
+    return result;
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMECONVERTER_H_
+#define _FCITX_RIMECONVERTER_H_
+
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <rime_api.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+// Converts text in batch with librime sessions that are not attached to any
+// input context. Sessions are kept per schema and reused by later calls.
+//
+// Only depends on rime_api_t, must be called from the thread that owns
+// librime.
+class RimeConverter {
+public:
+    static constexpr size_t MaxSessions = 4;
+
+    explicit RimeConverter(rime_api_t *api) : api_(api) {}
+    ~RimeConverter() { clear(); }
+
+    RimeConverter(const RimeConverter &) = delete;
+    RimeConverter &operator=(const RimeConverter &) = delete;
+
+    // At most limit candidates for every input, or nullopt if the schema
+    // isn't in the schema list of librime or can't be selected.
+    std::optional<std::vector<std::vector<std::string>>>
+    convert(const std::string &schema, const std::vector<std::string> &inputs,
+            size_t limit);
+
+    // Destroy all sessions, must be called before finalizing librime.
+    void clear();
+    size_t size() const { return sessions_.size(); }
+
+private:
+    RimeSessionId session(const std::string &schema);
+    bool deployed(const std::string &schema);
+    std::vector<std::string> candidates(RimeSessionId session,
+                                        const std::string &input,
+                                        size_t limit);
+
+    rime_api_t *api_;
+    // Most recently used first.
+    std::list<std::pair<std::string, RimeSessionId>> sessions_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMECONVERTER_H_
@@ -7,12 +7,18 @@
 #include "rimeengine.h"
 #include "notifications_public.h"
 #include "rimeaction.h"
+#include "rimeapi.h"
+#include "rimeprobes.h"
 #include "rimestate.h"
+#include "rimetraits.h"
+#include <atomic>
+#include <charconv>
 #include <cstdint>
 #include <cstring>
 #include <ctime>
 #include <dirent.h>
 #include <exception>
+#include <filesystem>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-config/rawconfig.h>
 #include <fcitx-utils/event.h>
@@ -47,12 +53,17 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 FCITX_DEFINE_LOG_CATEGORY(rime_log, "rime");
 
 namespace fcitx::rime {
@@ -61,6 +72,16 @@ namespace {
 
 // Allow notification for 60secs.
 constexpr uint64_t NotificationTimeout = 60000000;
+// Check memory pressure every 2secs.
+constexpr uint64_t MemoryPressureInterval = 2000000;
+// Trim heap 5secs after sessions are released.
+constexpr uint64_t TrimDelay = 5000000;
+
+void trimHeap() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
 
 std::unordered_map<std::string, std::unordered_map<std::string, bool>>
 parseAppOptions(rime_api_t *api, RimeConfig *config) {
@@ -113,14 +134,6 @@ std::vector<std::string> getListItemString(rime_api_t *api, RimeConfig *config,
     return values;
 }
 
-rime_api_t *EnsureRimeApi() {
-    auto *api = rime_get_api();
-    if (!api) {
-        throw std::runtime_error("Failed to get Rime API");
-    }
-    return api;
-}
-
 } // namespace
 
 class IMAction : public Action {
@@ -181,7 +194,7 @@ private:
 bool RimeEngine::firstRun_ = true;
 
 RimeEngine::RimeEngine(Instance *instance)
-    : instance_(instance), api_(EnsureRimeApi()),
+    : instance_(instance), api_(loadRimeApi()),
       factory_([this](InputContext &ic) { return new RimeState(this, ic); }),
       sessionPool_(this, getSharedStatePolicy()) {
     if constexpr (isAndroid() || isApple()) {
@@ -276,6 +289,9 @@ RimeEngine::RimeEngine(Instance *instance)
 }
 
 RimeEngine::~RimeEngine() {
+    buildCache_.reset();
+    worker_.stop();
+    converter_.clear();
     factory_.unregister();
     try {
         api_->finalize();
@@ -298,42 +314,44 @@ void RimeEngine::rimeStart(bool fullcheck) {
     }
 
     RIME_STRUCT(RimeTraits, fcitx_rime_traits);
-    fcitx_rime_traits.shared_data_dir = sharedDataDir_.c_str();
-    fcitx_rime_traits.app_name = "rime.fcitx-rime";
-    fcitx_rime_traits.user_data_dir = userDir.c_str();
-    fcitx_rime_traits.distribution_name = "Rime";
-    fcitx_rime_traits.distribution_code_name = "fcitx-rime";
-    fcitx_rime_traits.distribution_version = FCITX_RIME_VERSION;
-    // make librime only log to stderr
-    // https://github.com/rime/librime/commit/6d1b9b65de4e7784a68a17d10a3e5c900e4fd511
-    fcitx_rime_traits.log_dir = "";
-    switch (rime_log().logLevel()) {
-    case NoLog:
-        fcitx_rime_traits.min_log_level = 4;
-        break;
-    case Fatal:
-        fcitx_rime_traits.min_log_level = 3;
-        break;
-    case Error:
-    case Warn:
-    case Info:
-        fcitx_rime_traits.min_log_level = 2;
-        break;
-    case Debug:
-    default:
-        // Rime info is too noisy.
-        fcitx_rime_traits.min_log_level = 0;
-        break;
+    fillRimeTraits(fcitx_rime_traits, sharedDataDir_.c_str(), userDir.c_str(),
+                   rime_log().logLevel());
+    const char *version = api_->get_version ? api_->get_version() : nullptr;
+    buildCache_.emplace(*config_.sharedBuildCache, sharedDataDir_, userDir,
+                        version ? version : "");
+    const auto prebuiltDir = buildCache_->link().string();
+    if (buildCache_->enabled()) {
+        fcitx_rime_traits.prebuilt_data_dir = prebuiltDir.c_str();
     }
 
-    fcitx_rime_traits.modules = nullptr;
-
     if (firstRun_) {
         api_->setup(&fcitx_rime_traits);
         firstRun_ = false;
     }
     api_->initialize(&fcitx_rime_traits);
     api_->set_notification_handler(&rimeNotificationHandler, this);
+    if (!buildCache_->enabled()) {
+        startMaintenance(fullcheck);
+        return;
+    }
+
+    // Finding the cache entry stats all of the shared data, so it's done in
+    // a thread, and maintenance starts once the link to it is updated.
+    updateAppOptions();
+    const auto serial = ++buildCacheSerial_;
+    buildCache_->prepare([this, fullcheck, serial](bool found) {
+        eventDispatcher_.schedule([this, fullcheck, serial, found]() {
+            // Rime is restarted in between.
+            if (serial != buildCacheSerial_) {
+                return;
+            }
+            RIME_DEBUG() << "Shared build cache found: " << found;
+            startMaintenance(fullcheck);
+        });
+    });
+}
+
+void RimeEngine::startMaintenance(bool fullcheck) {
     api_->start_maintenance(fullcheck);
 
     if (!api_->is_maintenance_mode()) {
@@ -373,6 +391,11 @@ void RimeEngine::updateConfig() {
     if (constructed_ && factory_.registered()) {
         releaseAllSession(true);
     }
+    if (*config_.asyncKeyProcessing) {
+        worker_.start();
+    } else {
+        worker_.stop();
+    }
     try {
         api_->finalize();
     } catch (const std::exception &e) {
@@ -386,6 +409,72 @@ void RimeEngine::updateConfig() {
 
     deployAction_.setHotkey(config_.deploy.value());
     syncAction_.setHotkey(config_.synchronize.value());
+    // Turning metrics off discards what was collected.
+    metrics_.setEnabled(*config_.latencyMetrics);
+    if (!metrics_.enabled()) {
+        metrics_.clear();
+    }
+    memoryStats_.setEnabled(*config_.memoryMetrics);
+    if (!memoryStats_.enabled()) {
+        memoryStats_.clear();
+    }
+    watchdog_.setThreshold(static_cast<uint64_t>(*config_.slowCallThreshold) *
+                           1000);
+    if (!watchdog_.threshold()) {
+        watchdog_.clear();
+    }
+    latencyBudget_.setBudget(static_cast<uint64_t>(*config_.latencyBudget) *
+                             1000000);
+    std::unordered_map<std::string, uint64_t> schemaBudgets;
+    for (const auto &item : *config_.schemaLatencyBudget) {
+        const auto pos = item.rfind(':');
+        uint64_t budget = 0;
+        const char *end = item.data() + item.size();
+        if (pos == std::string::npos || pos == 0) {
+            RIME_WARN() << "Invalid schema latency budget: " << item;
+            continue;
+        }
+        auto [ptr, ec] = std::from_chars(item.data() + pos + 1, end, budget);
+        if (ec != std::errc() || ptr != end) {
+            RIME_WARN() << "Invalid schema latency budget: " << item;
+            continue;
+        }
+        schemaBudgets[item.substr(0, pos)] = budget * 1000000;
+    }
+    latencyBudget_.setSchemaBudgets(std::move(schemaBudgets));
+#ifndef FCITX_RIME_NO_DBUS
+    service_.setSnapshotInterval(*config_.metricsSnapshotInterval);
+#endif
+    if (*config_.recordTrace != traceRecorder_.recording()) {
+        if (*config_.recordTrace) {
+            startTrace("");
+        } else {
+            stopTrace();
+        }
+    }
+    if (*config_.shedOnMemoryPressure && memoryPressure_.available()) {
+        if (!memoryPressureTimer_) {
+            memoryPressureTimer_ = instance_->eventLoop().addTimeEvent(
+                CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + MemoryPressureInterval,
+                0, [this](EventSourceTime *source, uint64_t) {
+                    checkMemoryPressure();
+                    source->setTime(now(CLOCK_MONOTONIC) +
+                                    MemoryPressureInterval);
+                    source->setOneShot();
+                    return true;
+                });
+        }
+    } else {
+        memoryPressureTimer_.reset();
+        memoryPressureLevel_ = RimeMemoryPressureLevel::None;
+    }
+    if (*config_.recordKeys != keyTraceWriter_.recording()) {
+        if (*config_.recordKeys) {
+            startKeyRecording("");
+        } else {
+            stopKeyRecording();
+        }
+    }
 
     if (constructed_) {
         refreshStatusArea(0);
@@ -457,12 +546,20 @@ void RimeEngine::activate(const InputMethodEntry & /*entry*/,
     auto *ic = event.inputContext();
     refreshStatusArea(*ic);
     if (auto *state = this->state(ic)) {
+        state->flushUI();
+        state->invalidateUI();
         state->activate();
+#ifndef FCITX_RIME_NO_DBUS
+        service_.activate(state);
+#endif
     }
 }
 
 void RimeEngine::deactivate(const InputMethodEntry &entry,
                             InputContextEvent &event) {
+    if (auto *state = this->state(event.inputContext())) {
+        state->flushUI();
+    }
     if (event.type() == EventType::InputContextSwitchInputMethod) {
         auto *inputContext = event.inputContext();
         auto *state = this->state(inputContext);
@@ -488,6 +585,7 @@ void RimeEngine::keyEvent(const InputMethodEntry &entry, KeyEvent &event) {
     RIME_DEBUG() << "Rime receive key: " << event.rawKey() << " "
                  << event.isRelease();
     auto *inputContext = event.inputContext();
+    keyTraceWriter_.record(inputContext, event.rawKey(), event.isRelease());
     if (!event.isRelease()) {
         if (event.key().checkKeyList(*config_.deploy)) {
             deploy();
@@ -511,6 +609,7 @@ void RimeEngine::reset(const InputMethodEntry & /*entry*/,
     auto *inputContext = event.inputContext();
     auto *state = this->state(inputContext);
     state->clear();
+    state->invalidateUI();
     instance_->resetCompose(inputContext);
     inputContext->inputPanel().reset();
     inputContext->updatePreedit();
@@ -529,13 +628,26 @@ void RimeEngine::rimeNotificationHandler(void *context, RimeSessionId session,
                                          const char *messageValue) {
     RIME_DEBUG() << "Notification: " << session << " " << messageType << " "
                  << messageValue;
+    RIME_PROBE(notification, session, messageType, messageValue);
     auto *that = static_cast<RimeEngine *>(context);
-    if (that->mainThreadId_ == std::this_thread::get_id()) {
+    const bool mainThread = that->mainThreadId_ == std::this_thread::get_id();
+    if (mainThread) {
+        that->notificationSerial_ += 1;
         that->notifyImmediately(session, messageType, messageValue);
+    } else if (auto *result = RimeKeyResultScope::current(session);
+               result && std::string_view(messageType) == "option") {
+        // Raised by a key on the worker, applied together with its result.
+        result->changedOptions.emplace_back(messageValue);
     }
+    that->pendingNotifications_ += 1;
     that->eventDispatcher_.schedule(
-        [that, session, messageType = std::string(messageType),
+        [that, session, mainThread, messageType = std::string(messageType),
          messageValue = std::string(messageValue)]() {
+            that->pendingNotifications_ -= 1;
+            if (!mainThread) {
+                // From worker or maintenance thread.
+                that->notificationSerial_ += 1;
+            }
             that->notify(session, messageType, messageValue);
         });
 }
@@ -563,13 +675,31 @@ void RimeEngine::notify(RimeSessionId session, const std::string &messageType,
     if (messageType == "deploy") {
         tipId = "fcitx-rime-deploy";
         icon = "fcitx_rime_deploy";
+        if (messageValue != "start" && maintenanceStart_) {
+            auto duration = now(CLOCK_MONOTONIC) - maintenanceStart_;
+            (maintenanceIsSync_ ? lastSyncDuration_ : lastDeployDuration_) =
+                duration;
+            RIME_PROBE(deploy_finish, maintenanceIsSync_ ? "sync" : "deploy",
+                       messageValue == "success", duration);
+            maintenanceStart_ = 0;
+            maintenanceIsSync_ = false;
+            scheduleTrim();
+        }
         if (messageValue == "start") {
+            // Maintenance may also be started by rimeStart on its own.
+            if (!maintenanceStart_) {
+                maintenanceStart_ = now(CLOCK_MONOTONIC);
+                RIME_PROBE(deploy_start, "deploy");
+            }
             message = _("Rime is under maintenance. It may take a few "
                         "seconds. Please wait until it is finished...");
         } else if (messageValue == "success") {
             message = _("Rime is ready.");
             if (!api_->is_maintenance_mode()) {
+                worker_.drain();
                 if (needRefreshAppOption_) {
+                    RimeCallWatch watch(watchdog_, api_, "deploy_config_file",
+                                        0);
                     api_->deploy_config_file("fcitx5.yaml", "config_version");
                     updateAppOptions();
                     needRefreshAppOption_ = false;
@@ -590,6 +720,9 @@ void RimeEngine::notify(RimeSessionId session, const std::string &messageType,
         // Schema is changed either via status area or shortcut
         refreshStatusArea(session);
     }
+#ifndef FCITX_RIME_NO_DBUS
+    service_.notify(session, messageType, messageValue);
+#endif
 
     auto *notifications = this->notifications();
     const auto current = now(CLOCK_MONOTONIC);
@@ -654,6 +787,8 @@ std::string RimeEngine::subModeIconImpl(const InputMethodEntry & /*unused*/,
 }
 
 void RimeEngine::releaseAllSession(bool snapshot) {
+    worker_.drain();
+    converter_.clear();
     instance_->inputContextManager().foreach([&](InputContext *ic) {
         if (auto *state = this->state(ic)) {
             if (snapshot) {
@@ -663,10 +798,56 @@ void RimeEngine::releaseAllSession(bool snapshot) {
         }
         return true;
     });
+    scheduleTrim();
+}
+
+void RimeEngine::checkMemoryPressure() {
+    const auto level = memoryPressure_.read();
+    // Only shed when pressure rises, released sessions are created again
+    // with their snapshot once they are used.
+    if (level > memoryPressureLevel_) {
+        shedMemory(level);
+    }
+    memoryPressureLevel_ = level;
+}
+
+void RimeEngine::shedMemory(RimeMemoryPressureLevel level) {
+    RIME_DEBUG() << "Shed memory, pressure level: " << static_cast<int>(level);
+    worker_.drain();
+    converter_.clear();
+    if (level == RimeMemoryPressureLevel::Critical) {
+        instance_->inputContextManager().foreach([this](InputContext *ic) {
+            auto *state = this->state(ic);
+            if (state && !ic->hasFocus()) {
+                state->snapshot();
+                state->release();
+            }
+            return true;
+        });
+    }
+    trimHeap();
+}
+
+void RimeEngine::scheduleTrim() {
+    const auto deadline = now(CLOCK_MONOTONIC) + TrimDelay;
+    if (trimTimer_) {
+        trimTimer_->setTime(deadline);
+    } else {
+        trimTimer_ = instance_->eventLoop().addTimeEvent(
+            CLOCK_MONOTONIC, deadline, 0,
+            [](EventSourceTime * /*unused*/, uint64_t /*unused*/) {
+                trimHeap();
+                return true;
+            });
+    }
+    trimTimer_->setOneShot();
 }
 
 void RimeEngine::deploy() {
     RIME_DEBUG() << "Rime Deploy";
+    maintenanceStart_ = now(CLOCK_MONOTONIC);
+    maintenanceIsSync_ = false;
+    RIME_PROBE(deploy_start, "deploy");
     releaseAllSession(true);
     api_->finalize();
     allowNotification();
@@ -675,6 +856,9 @@ void RimeEngine::deploy() {
 
 void RimeEngine::sync(bool userTriggered) {
     RIME_DEBUG() << "Rime Sync user data";
+    maintenanceStart_ = now(CLOCK_MONOTONIC);
+    maintenanceIsSync_ = true;
+    RIME_PROBE(deploy_start, "sync");
     releaseAllSession(true);
     if (userTriggered) {
         allowNotification();
@@ -685,7 +869,12 @@ void RimeEngine::sync(bool userTriggered) {
 void RimeEngine::updateActionsForSchema(const std::string &schema) {
     RimeConfig config{};
 
-    if (!api_->schema_open(schema.c_str(), &config)) {
+    bool opened;
+    {
+        RimeCallWatch watch(watchdog_, api_, "schema_open", 0, schema);
+        opened = api_->schema_open(schema.c_str(), &config);
+    }
+    if (!opened) {
         return;
     }
     auto switchPaths = getListItemPath(api_, &config, "switches");
@@ -721,13 +910,39 @@ void RimeEngine::updateActionsForSchema(const std::string &schema) {
     api_->config_close(&config);
 }
 
+void RimeEngine::updateKeyInterestForSchema(const std::string &schema,
+                                            RimeConfig *defaultConfig) {
+    RimeConfig config{};
+
+    bool opened;
+    {
+        RimeCallWatch watch(watchdog_, api_, "schema_open", 0, schema);
+        opened = api_->schema_open(schema.c_str(), &config);
+    }
+    if (!opened) {
+        return;
+    }
+    keyInterest_[schema] = RimeKeyInterest(api_, &config, defaultConfig);
+    api_->config_close(&config);
+}
+
 void RimeEngine::updateSchemaMenu() {
+    worker_.drain();
     schemas_.clear();
+    schemaList_.clear();
     schemActions_.clear();
     optionActions_.clear();
+    keyInterest_.clear();
+    RimeConfig defaultConfig{};
+    const bool hasDefaultConfig = api_->config_open("default", &defaultConfig);
     RimeSchemaList list;
     list.size = 0;
-    if (api_->get_schema_list(&list)) {
+    bool hasList;
+    {
+        RimeCallWatch watch(watchdog_, api_, "get_schema_list", 0);
+        hasList = api_->get_schema_list(&list);
+    }
+    if (hasList) {
         schemActions_.emplace_back();
 
         schemActions_.back().setShortText(_("Latin Mode"));
@@ -753,10 +968,16 @@ void RimeEngine::updateSchemaMenu() {
             instance_->userInterfaceManager().registerAction(&schemaAction);
             schemaMenu_.insertAction(&separatorAction_, &schemaAction);
             updateActionsForSchema(schemaId);
+            updateKeyInterestForSchema(
+                schemaId, hasDefaultConfig ? &defaultConfig : nullptr);
             schemas_.insert(schemaId);
+            schemaList_.emplace_back(schemaId, list.list[i].name);
         }
         api_->free_schema_list(&list);
     }
+    if (hasDefaultConfig) {
+        api_->config_close(&defaultConfig);
+    }
 }
 
 void RimeEngine::refreshSessionPoolPolicy() {
@@ -781,6 +1002,77 @@ PropertyPropagatePolicy RimeEngine::getSharedStatePolicy() {
     }
 }
 
+bool RimeEngine::startTrace(const std::string &path) {
+    std::filesystem::path tracePath = path;
+    if (tracePath.empty()) {
+        auto cacheDir =
+            StandardPaths::global().userDirectory(StandardPathsType::Cache);
+        fs::makePath(cacheDir);
+        tracePath = cacheDir / "fcitx5-rime-trace.json";
+    }
+    if (!traceRecorder_.start(tracePath)) {
+        RIME_ERROR() << "Failed to record trace to " << tracePath;
+        return false;
+    }
+    RIME_DEBUG() << "Recording trace to " << tracePath;
+    traceRecorder_.counter("sessions", sessionPool_.size());
+    return true;
+}
+
+std::string RimeEngine::stopTrace() {
+    if (!traceRecorder_.recording()) {
+        return {};
+    }
+    traceRecorder_.stop();
+    RIME_DEBUG() << "Trace is saved to " << traceRecorder_.path();
+    return traceRecorder_.path().string();
+}
+
+bool RimeEngine::startKeyRecording(const std::string &path) {
+    std::filesystem::path recordPath = path;
+    if (recordPath.empty()) {
+        auto cacheDir =
+            StandardPaths::global().userDirectory(StandardPathsType::Cache);
+        fs::makePath(cacheDir);
+        recordPath = cacheDir / "fcitx5-rime-keys.bin";
+    }
+    if (!keyTraceWriter_.start(recordPath)) {
+        RIME_ERROR() << "Failed to record keys to " << recordPath;
+        return false;
+    }
+    RIME_DEBUG() << "Recording keys to " << recordPath;
+    return true;
+}
+
+std::string RimeEngine::stopKeyRecording() {
+    if (!keyTraceWriter_.recording()) {
+        return {};
+    }
+    keyTraceWriter_.stop();
+    RIME_DEBUG() << "Keys are saved to " << keyTraceWriter_.path();
+    return keyTraceWriter_.path().string();
+}
+
+uint32_t RimeEngine::attachedInputContexts() {
+    uint32_t count = 0;
+    instance_->inputContextManager().foreach([this, &count](InputContext *ic) {
+        if (auto *state = this->state(ic); state && state->session(false)) {
+            count += 1;
+        }
+        return true;
+    });
+    return count;
+}
+
+bool RimeEngine::isKeyInteresting(const std::string &schema,
+                                  const Key &key) const {
+    auto iter = keyInterest_.find(schema);
+    if (iter == keyInterest_.end()) {
+        return true;
+    }
+    return iter->second.isInteresting(key);
+}
+
 bool RimeEngine::isCapsLockOn(InputContext *ic) const {
     if (auto xkbState = instance_->xkbStateMask(ic->display())) {
         auto lockedMods = std::get<2>(*xkbState);
@@ -6,8 +6,18 @@
 #ifndef _FCITX_RIMEENGINE_H_
 #define _FCITX_RIMEENGINE_H_
 
+#include "rimebuildcache.h"
+#include "rimeconverter.h"
+#include "rimekeyinterest.h"
+#include "rimekeytrace.h"
+#include "rimememorypressure.h"
+#include "rimemetrics.h"
+#include "rimetracing.h"
+#include "rimewatchdog.h"
+#include "rimeworker.h"
 #include "rimesession.h"
 #include "rimestate.h"
+#include <atomic>
 #include <cstdint>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
@@ -38,12 +48,15 @@
 #include <fcitx/menu.h>
 #include <list>
 #include <memory>
+#include <optional>
 #include <rime_api.h>
 #include <string>
 #include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #ifndef FCITX_RIME_NO_DBUS
 #include "rimeservice.h"
@@ -116,13 +129,74 @@ FCITX_CONFIGURATION(
         this, "Synchronize", _("Synchronize"), {}};
     Option<bool> latinModeNameFromSchema{
         this, "LatinModeNameFromSchema",
-        _("Use latin mode name defined in schema"), false};);
+        _("Use latin mode name defined in schema"), false};
+    Option<bool> coalesceKeyEvents{
+        this, "CoalesceKeyEvents",
+        _("Update candidate window only once for a burst of key events"),
+        false};
+    Option<int, IntConstrain> uiUpdateInterval{
+        this, "UIUpdateInterval",
+        _("Minimum interval between candidate window updates (ms)"), 0,
+        IntConstrain(0, 200)};
+    Option<bool> latencyMetrics{
+        this, "LatencyMetrics",
+        _("Collect key event latency, schema usage and candidate statistics"),
+        false};
+    Option<int, IntConstrain> metricsSnapshotInterval{
+        this, "MetricsSnapshotInterval",
+        _("Interval of broadcasting the statistics above over D-Bus, only "
+          "when they are collected (s)"),
+        0, IntConstrain(0, 3600)};
+    Option<bool> recordTrace{this, "RecordTrace",
+                             _("Record key event trace for Perfetto"),
+                             false};
+    Option<bool> recordKeys{
+        this, "RecordKeys",
+        _("Record keys for replaying (Only fields marked as password are "
+          "skipped)"),
+        false};
+    Option<int, IntConstrain> slowCallThreshold{
+        this, "SlowCallThreshold",
+        _("Log librime calls slower than this threshold (ms, 0 to disable)"),
+        0, IntConstrain(0, 10000)};
+    Option<int, IntConstrain> latencyBudget{
+        this, "LatencyBudget",
+        _("Simplify input panel when processing a key is slower than this "
+          "(ms, 0 to disable)"),
+        0, IntConstrain(0, 1000)};
+    Option<std::vector<std::string>> schemaLatencyBudget{
+        this, "SchemaLatencyBudget",
+        _("Latency budget of a schema, as SCHEMA:MS (Overrides the one above)"),
+        {}};
+    Option<bool> memoryMetrics{
+        this, "MemoryMetrics",
+        _("Measure memory used by sessions and schemas"), false};
+    Option<bool> shedOnMemoryPressure{
+        this, "ShedOnMemoryPressure",
+        _("Release idle sessions under memory pressure"), false};
+    Option<std::string> sharedBuildCache{
+        this, "SharedBuildCache",
+        _("Build cache directory published by root (Empty to disable)"),
+        ""};
+    Option<bool> asyncKeyProcessing{
+        this, "AsyncKeyProcessing",
+        _("Process keys in a separate thread (Experimental)"), false};);
+
+// Number of preedit / input panel updates sent to the frontend, and the ones
+// skipped because the content is identical to the last one.
+struct RimeUpdateCounters {
+    uint64_t preeditSent = 0;
+    uint64_t preeditSkipped = 0;
+    uint64_t panelSent = 0;
+    uint64_t panelSkipped = 0;
+};
 
 class RimeEngine final : public InputMethodEngineV2 {
 public:
     RimeEngine(Instance *instance);
     ~RimeEngine();
     Instance *instance() { return instance_; }
+    EventDispatcher &eventDispatcher() { return eventDispatcher_; }
     void activate(const InputMethodEntry &entry,
                   InputContextEvent &event) override;
     void deactivate(const InputMethodEntry &entry,
@@ -166,9 +240,37 @@ public:
 
     void allowNotification(std::string type = "");
     const auto &schemas() const { return schemas_; }
+    // Id and name of schemas, in the order of get_schema_list.
+    const auto &schemaList() const { return schemaList_; }
     const auto &optionActions() const { return optionActions_; };
 
     bool isCapsLockOn(InputContext *ic) const;
+    // Whether schema may handle the key when nothing is being composed.
+    bool isKeyInteresting(const std::string &schema, const Key &key) const;
+
+    RimeUpdateCounters &updateCounters() { return updateCounters_; }
+    RimeMetrics &metrics() { return metrics_; }
+    RimeMemoryStats &memoryStats() { return memoryStats_; }
+    RimeWatchdog &watchdog() { return watchdog_; }
+    RimeLatencyBudget &latencyBudget() { return latencyBudget_; }
+    RimeWorker &worker() { return worker_; }
+    RimeConverter &converter() { return converter_; }
+    // Start recording trace to path, or the default one if path is empty.
+    bool startTrace(const std::string &path);
+    // Return the path of the trace, empty if it is not recording.
+    std::string stopTrace();
+    // Same as the trace, but for the keys replayed by rime-replay.
+    bool startKeyRecording(const std::string &path);
+    std::string stopKeyRecording();
+    // Notifications from rime that are not yet handled on main thread.
+    uint32_t pendingNotifications() const { return pendingNotifications_; }
+    // Duration of last deploy and sync in microseconds.
+    uint64_t lastDeployDuration() const { return lastDeployDuration_; }
+    uint64_t lastSyncDuration() const { return lastSyncDuration_; }
+    // Number of input contexts that currently hold a session.
+    uint32_t attachedInputContexts();
+    // Increased whenever rime sends a notification on the main thread.
+    uint64_t notificationSerial() const { return notificationSerial_; }
 
 private:
     static void rimeNotificationHandler(void *context, RimeSessionId session,
@@ -179,17 +281,24 @@ private:
     void sync(bool userTriggered);
     void updateSchemaMenu();
     void updateActionsForSchema(const std::string &schema);
+    void updateKeyInterestForSchema(const std::string &schema,
+                                    RimeConfig *defaultConfig);
     void notifyImmediately(RimeSessionId session, std::string_view type,
                            std::string_view value);
     void notify(RimeSessionId session, const std::string &type,
                 const std::string &value);
     void releaseAllSession(bool snapshot = false);
+    void startMaintenance(bool fullcheck);
     void updateAppOptions();
     void refreshStatusArea(InputContext &ic);
     void refreshStatusArea(RimeSessionId session);
     void updateStatusArea(RimeSessionId session);
     void refreshSessionPoolPolicy();
     PropertyPropagatePolicy getSharedStatePolicy();
+    void checkMemoryPressure();
+    void shedMemory(RimeMemoryPressureLevel level);
+    // Return freed memory to the system once it has been idle for a while.
+    void scheduleTrim();
 
     bool constructed_ = false;
     std::string sharedDataDir_;
@@ -203,6 +312,29 @@ private:
     std::string allowNotificationType_;
     FactoryFor<RimeState> factory_;
     bool needRefreshAppOption_ = false;
+    RimeUpdateCounters updateCounters_;
+    RimeMetrics metrics_;
+    RimeMemoryStats memoryStats_;
+    RimeTraceRecorder traceRecorder_;
+    RimeKeyTraceWriter keyTraceWriter_;
+    RimeWatchdog watchdog_;
+    RimeLatencyBudget latencyBudget_;
+    RimeWorker worker_{eventDispatcher_};
+    RimeConverter converter_{api_};
+    RimeMemoryPressure memoryPressure_;
+    RimeMemoryPressureLevel memoryPressureLevel_ =
+        RimeMemoryPressureLevel::None;
+    std::unique_ptr<EventSourceTime> memoryPressureTimer_;
+    std::unique_ptr<EventSourceTime> trimTimer_;
+    std::optional<RimeBuildCache> buildCache_;
+    uint64_t buildCacheSerial_ = 0;
+    std::atomic<uint32_t> pendingNotifications_ = 0;
+    // Start time of current maintenance, and whether it is a sync.
+    uint64_t maintenanceStart_ = 0;
+    bool maintenanceIsSync_ = false;
+    uint64_t lastDeployDuration_ = 0;
+    uint64_t lastSyncDuration_ = 0;
+    uint64_t notificationSerial_ = 0;
 
     std::unique_ptr<Action> imAction_;
     SimpleAction separatorAction_;
@@ -216,10 +348,12 @@ private:
     FCITX_ADDON_DEPENDENCY_LOADER(notifications, instance_->addonManager());
 
     std::unordered_set<std::string> schemas_;
+    std::vector<std::pair<std::string, std::string>> schemaList_;
     std::list<SimpleAction> schemActions_;
     std::unordered_map<std::string,
                        std::list<std::unique_ptr<RimeOptionAction>>>
         optionActions_;
+    std::unordered_map<std::string, RimeKeyInterest> keyInterest_;
     Menu schemaMenu_;
     std::unique_ptr<HandlerTableEntry<EventHandler>> globalConfigReloadHandle_;
 
@@ -236,6 +370,7 @@ private:
 FCITX_DECLARE_LOG_CATEGORY(rime_log);
 
 #define RIME_DEBUG() FCITX_LOGC(rime_log, Debug)
+#define RIME_WARN() FCITX_LOGC(rime_log, Warn)
 #define RIME_ERROR() FCITX_LOGC(rime_log, Error)
 
 #endif // _FCITX_RIMEENGINE_H_
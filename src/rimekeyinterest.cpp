@@ -0,0 +1,175 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimekeyinterest.h"
+#include <cstdint>
+#include <fcitx-utils/charutils.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <rime_api.h>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+namespace fcitx::rime {
+
+namespace {
+
+// Processors that ignore keys without modifier when nothing is composed,
+// unless they are explicitly configured to handle them.
+const std::unordered_set<std::string_view> knownProcessors = {
+    "ascii_composer", "recognizer",    "key_binder",   "speller",
+    "punctuator",     "selector",      "navigator",    "express_editor",
+    "fluid_editor",   "fluency_editor"};
+
+template <typename Callback>
+void foreachListItem(rime_api_t *api, RimeConfig *config, const char *path,
+                     Callback callback) {
+    RimeConfigIterator iter;
+    if (api->config_begin_list(&iter, config, path)) {
+        while (api->config_next(&iter)) {
+            callback(iter.path);
+        }
+        api->config_end(&iter);
+    }
+}
+
+std::string_view configString(rime_api_t *api, RimeConfig *config,
+                              const std::string &path) {
+    const auto *value = api->config_get_cstring(config, path.c_str());
+    return value ? value : "";
+}
+
+} // namespace
+
+RimeKeyInterest::RimeKeyInterest(rime_api_t *api, RimeConfig *schema,
+                                 RimeConfig *defaultConfig) {
+    bool hasProcessor = false;
+    bool allKnown = true;
+    foreachListItem(api, schema, "engine/processors",
+                    [&](const char *path) {
+                        auto processor = configString(api, schema, path);
+                        processor = processor.substr(0, processor.find('@'));
+                        hasProcessor = true;
+                        if (!knownProcessors.contains(processor)) {
+                            allKnown = false;
+                        }
+                    });
+    if (!hasProcessor || !allKnown) {
+        return;
+    }
+    all_ = false;
+
+    for (const char *path : {"speller/alphabet", "speller/initials",
+                             "speller/delimiter"}) {
+        for (char c : configString(api, schema, path)) {
+            addKeySym(Key::keySymFromUnicode(static_cast<uint8_t>(c)));
+        }
+    }
+
+    foreachListItem(
+        api, schema, "key_binder/bindings", [&](const char *path) {
+            std::string itemPath = path;
+            auto when = configString(api, schema, itemPath + "/when");
+            if (when == "composing" || when == "has_menu" ||
+                when == "paging") {
+                return;
+            }
+            addKeyString(configString(api, schema, itemPath + "/accept"));
+        });
+
+    for (auto *config : {schema, defaultConfig}) {
+        if (!config) {
+            continue;
+        }
+        foreachListItem(api, config, "switcher/hotkeys", [&](const char *path) {
+            addKeyString(configString(api, config, path));
+        });
+    }
+
+    RimeConfigIterator iter;
+    if (api->config_begin_map(&iter, schema, "ascii_composer/switch_key")) {
+        while (api->config_next(&iter)) {
+            std::string_view key = iter.key;
+            addKeyString(key);
+            // Ascii composer tracks whether any other key is pressed while
+            // holding shift or control, so it needs to see them.
+            if (configString(api, schema, iter.path) == "noop") {
+                continue;
+            }
+            if (key.starts_with("Shift")) {
+                shiftSwitch_ = true;
+            } else if (key.starts_with("Control")) {
+                controlSwitch_ = true;
+            }
+        }
+        api->config_end(&iter);
+    }
+    addKeySym(FcitxKey_Caps_Lock);
+}
+
+bool RimeKeyInterest::isInteresting(const Key &key) const {
+    if (all_ || key.isModifier() || hasKeySym(key.sym())) {
+        return true;
+    }
+    const auto states = key.states();
+    if ((shiftSwitch_ && states.test(KeyState::Shift)) ||
+        (controlSwitch_ && states.test(KeyState::Ctrl))) {
+        return true;
+    }
+    if (states.testAny(
+            KeyStates{KeyState::Ctrl, KeyState::Alt, KeyState::Super})) {
+        return false;
+    }
+    // Printable keys may be handled by speller, punctuator or recognizer.
+    auto chr = Key::keySymToUnicode(key.sym());
+    return chr >= 0x20 && chr != 0x7f;
+}
+
+void RimeKeyInterest::addKeySym(KeySym sym) {
+    if (sym == FcitxKey_None) {
+        return;
+    }
+    if (sym < keySyms_.size()) {
+        keySyms_.set(sym);
+    } else {
+        extraKeySyms_.insert(sym);
+    }
+}
+
+void RimeKeyInterest::addKeyString(std::string_view key) {
+    // Rime key is in the form of Modifier+...+KeySym, modifiers are ignored
+    // here so we don't need to care about how they are normalized.
+    if (key.empty()) {
+        return;
+    }
+    if (auto pos = key.rfind('+', key.size() - 2);
+        key.size() > 1 && pos != std::string_view::npos) {
+        key.remove_prefix(pos + 1);
+    }
+    auto sym = Key::keySymFromString(key);
+    addKeySym(sym);
+    if (sym == FcitxKey_Tab) {
+        addKeySym(FcitxKey_ISO_Left_Tab);
+    }
+    if (sym < 0x80) {
+        const auto c = static_cast<char>(sym);
+        if (charutils::islower(c)) {
+            addKeySym(static_cast<KeySym>(charutils::toupper(c)));
+        } else if (charutils::isupper(c)) {
+            addKeySym(static_cast<KeySym>(charutils::tolower(c)));
+        }
+    }
+}
+
+bool RimeKeyInterest::hasKeySym(KeySym sym) const {
+    if (sym < keySyms_.size()) {
+        return keySyms_.test(sym);
+    }
+    return extraKeySyms_.contains(sym);
+}
+
+} // namespace fcitx::rime
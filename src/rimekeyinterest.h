@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEKEYINTEREST_H_
+#define _FCITX_RIMEKEYINTEREST_H_
+
+#include <bitset>
+#include <cstdint>
+#include <fcitx-utils/key.h>
+#include <rime_api.h>
+#include <string_view>
+#include <unordered_set>
+
+namespace fcitx::rime {
+
+// Keys that a schema may react to while nothing is being composed.
+//
+// This is only an approximation built from the configuration of the standard
+// processors, so it errs on the side of being interested. A schema using any
+// other processor (e.g. lua) is interested in every key.
+class RimeKeyInterest {
+public:
+    // Interested in every key.
+    RimeKeyInterest() = default;
+    RimeKeyInterest(rime_api_t *api, RimeConfig *schema,
+                    RimeConfig *defaultConfig);
+
+    bool isInteresting(const Key &key) const;
+
+private:
+    void addKeySym(KeySym sym);
+    void addKeyString(std::string_view key);
+    bool hasKeySym(KeySym sym) const;
+
+    bool all_ = true;
+    bool shiftSwitch_ = false;
+    bool controlSwitch_ = false;
+    std::bitset<0x10000> keySyms_;
+    std::unordered_set<uint32_t> extraKeySyms_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEKEYINTEREST_H_
@@ -0,0 +1,162 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimekeytrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcitx-utils/capabilityflags.h>
+#include <fcitx-utils/key.h>
+#include <fcitx/inputcontext.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unistd.h>
+
+namespace fcitx::rime {
+
+namespace {
+
+constexpr char Magic[4] = {'F', 'R', 'K', 'T'};
+
+uint64_t microseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+template <typename T>
+void writeValue(std::FILE *file, T value) {
+    std::fwrite(&value, sizeof(value), 1, file);
+}
+
+template <typename T>
+bool readValue(std::FILE *file, T &value) {
+    return std::fread(&value, sizeof(value), 1, file) == 1;
+}
+
+} // namespace
+
+RimeKeyTraceWriter::~RimeKeyTraceWriter() { stop(); }
+
+bool RimeKeyTraceWriter::start(const std::filesystem::path &path) {
+    stop();
+    // Create a new file, so it can't be a file or link that others can read.
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+        return false;
+    }
+    const int fd = open(path.c_str(),
+                        O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    file_ = fdopen(fd, "wb");
+    if (!file_) {
+        close(fd);
+        return false;
+    }
+    path_ = path;
+    start_ = microseconds();
+    std::fwrite(Magic, sizeof(Magic), 1, file_);
+    writeValue(file_, Version);
+    return true;
+}
+
+void RimeKeyTraceWriter::stop() {
+    if (!file_) {
+        return;
+    }
+    std::fclose(file_);
+    file_ = nullptr;
+    inputContexts_.clear();
+}
+
+void RimeKeyTraceWriter::record(InputContext *ic, const Key &rawKey,
+                                bool isRelease) {
+    if (!file_ ||
+        ic->capabilityFlags().testAny(CapabilityFlag::PasswordOrSensitive)) {
+        return;
+    }
+    auto [iter, inserted] =
+        inputContexts_.emplace(ic->uuid(), inputContexts_.size());
+    if (inserted) {
+        const auto &program = ic->program();
+        const auto length = static_cast<uint16_t>(
+            std::min<size_t>(program.size(), UINT16_MAX));
+        writeValue(file_, RimeKeyTraceRecordType::Program);
+        writeValue(file_, iter->second);
+        writeValue(file_, length);
+        std::fwrite(program.data(), 1, length, file_);
+    }
+    writeValue(file_, RimeKeyTraceRecordType::Key);
+    writeValue(file_, microseconds() - start_);
+    writeValue(file_, iter->second);
+    writeValue(file_, static_cast<uint32_t>(rawKey.sym()));
+    writeValue(file_, static_cast<uint32_t>(rawKey.states()));
+    writeValue(file_, static_cast<uint8_t>(isRelease));
+}
+
+RimeKeyTraceReader::~RimeKeyTraceReader() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+bool RimeKeyTraceReader::open(const std::filesystem::path &path) {
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        return false;
+    }
+    char magic[sizeof(Magic)];
+    uint32_t version = 0;
+    return std::fread(magic, sizeof(magic), 1, file_) == 1 &&
+           std::memcmp(magic, Magic, sizeof(Magic)) == 0 &&
+           readValue(file_, version) &&
+           version == RimeKeyTraceWriter::Version;
+}
+
+std::optional<RimeKeyTraceRecord> RimeKeyTraceReader::next() {
+    RimeKeyTraceRecord record;
+    if (!file_ || !readValue(file_, record.type)) {
+        return std::nullopt;
+    }
+    switch (record.type) {
+    case RimeKeyTraceRecordType::Program: {
+        uint16_t length = 0;
+        if (!readValue(file_, record.inputContext) ||
+            !readValue(file_, length)) {
+            return std::nullopt;
+        }
+        record.program.resize(length);
+        if (length &&
+            std::fread(record.program.data(), 1, length, file_) != length) {
+            return std::nullopt;
+        }
+        return record;
+    }
+    case RimeKeyTraceRecordType::Key: {
+        uint32_t sym = 0;
+        uint32_t states = 0;
+        uint8_t release = 0;
+        if (!readValue(file_, record.timestamp) ||
+            !readValue(file_, record.inputContext) ||
+            !readValue(file_, sym) || !readValue(file_, states) ||
+            !readValue(file_, release)) {
+            return std::nullopt;
+        }
+        record.key = Key(static_cast<KeySym>(sym), KeyStates(states));
+        record.isRelease = release;
+        return record;
+    }
+    }
+    return std::nullopt;
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEKEYTRACE_H_
+#define _FCITX_RIMEKEYTRACE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <fcitx-utils/key.h>
+#include <fcitx/inputcontext.h>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace fcitx::rime {
+
+// A key trace is the magic "FRKT", a version, and a sequence of records, all
+// integers are in host byte order. Each record starts with its type.
+//
+// Program: u32 input context id, u16 length, program name. Written before
+// the first key of an input context.
+// Key: u64 timestamp in microseconds since the start of recording, u32 input
+// context id, u32 keysym, u32 states, u8 release.
+enum class RimeKeyTraceRecordType : uint8_t { Program = 0, Key = 1 };
+
+struct RimeKeyTraceRecord {
+    RimeKeyTraceRecordType type;
+    uint32_t inputContext = 0;
+    // Only for Program.
+    std::string program;
+    // Only for Key.
+    uint64_t timestamp = 0;
+    Key key;
+    bool isRelease = false;
+};
+
+// Append the keys received by the engine to a file, which is only readable
+// by the user. Only fields that the application marks as password or
+// sensitive are skipped, a password typed into any other field is recorded.
+class RimeKeyTraceWriter {
+public:
+    static constexpr uint32_t Version = 1;
+
+    RimeKeyTraceWriter() = default;
+    ~RimeKeyTraceWriter();
+
+    bool start(const std::filesystem::path &path);
+    void stop();
+    bool recording() const { return file_ != nullptr; }
+    const std::filesystem::path &path() const { return path_; }
+
+    void record(InputContext *ic, const Key &rawKey, bool isRelease);
+
+private:
+    std::FILE *file_ = nullptr;
+    std::filesystem::path path_;
+    uint64_t start_ = 0;
+    // Small ids assigned in the order the input contexts are seen.
+    std::map<ICUUID, uint32_t> inputContexts_;
+};
+
+class RimeKeyTraceReader {
+public:
+    RimeKeyTraceReader() = default;
+    ~RimeKeyTraceReader();
+
+    // Return false if the file can't be opened or has a different version.
+    bool open(const std::filesystem::path &path);
+    // Return nullopt at the end of the trace, or on a truncated record.
+    std::optional<RimeKeyTraceRecord> next();
+
+private:
+    std::FILE *file_ = nullptr;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEKEYTRACE_H_
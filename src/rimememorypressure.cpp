@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimememorypressure.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <string>
+#include <system_error>
+
+namespace fcitx::rime {
+
+namespace {
+
+std::filesystem::path cgroupPressurePath() {
+    // cgroup v2 has a single line "0::/path".
+    std::ifstream cgroup("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroup, line)) {
+        if (!line.starts_with("0::")) {
+            continue;
+        }
+        auto path = std::filesystem::path("/sys/fs/cgroup") /
+                    std::filesystem::path(line.substr(3)).relative_path() /
+                    "memory.pressure";
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec)) {
+            return path;
+        }
+    }
+    return {};
+}
+
+} // namespace
+
+RimeMemoryPressure::RimeMemoryPressure() {
+    path_ = cgroupPressurePath();
+    std::error_code ec;
+    if (path_.empty() &&
+        std::filesystem::exists("/proc/pressure/memory", ec)) {
+        path_ = "/proc/pressure/memory";
+    }
+}
+
+RimeMemoryPressureLevel RimeMemoryPressure::read() const {
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    // full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    std::ifstream file(path_);
+    std::string type;
+    std::string avg10;
+    double some = 0;
+    double full = 0;
+    while (file >> type >> avg10) {
+        file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        if (!avg10.starts_with("avg10=")) {
+            continue;
+        }
+        const double value = std::strtod(avg10.c_str() + 6, nullptr);
+        if (type == "some") {
+            some = value;
+        } else if (type == "full") {
+            full = value;
+        }
+    }
+    if (some >= CriticalSome || full >= CriticalFull) {
+        return RimeMemoryPressureLevel::Critical;
+    }
+    if (some >= ModerateSome) {
+        return RimeMemoryPressureLevel::Moderate;
+    }
+    return RimeMemoryPressureLevel::None;
+}
+
+} // namespace fcitx::rime
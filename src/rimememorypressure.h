@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEMEMORYPRESSURE_H_
+#define _FCITX_RIMEMEMORYPRESSURE_H_
+
+#include <filesystem>
+
+namespace fcitx::rime {
+
+enum class RimeMemoryPressureLevel { None, Moderate, Critical };
+
+// Read memory pressure from Linux PSI, of the cgroup of this process if it
+// is available, or the whole system.
+class RimeMemoryPressure {
+public:
+    // Percentage of the last 10 seconds that some or all tasks are stalled
+    // on memory.
+    static constexpr double ModerateSome = 10;
+    static constexpr double CriticalSome = 40;
+    static constexpr double CriticalFull = 5;
+
+    RimeMemoryPressure();
+
+    bool available() const { return !path_.empty(); }
+    const std::filesystem::path &path() const { return path_; }
+    RimeMemoryPressureLevel read() const;
+
+private:
+    std::filesystem::path path_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEMEMORYPRESSURE_H_
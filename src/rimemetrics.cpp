@@ -0,0 +1,252 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimemetrics.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace fcitx::rime {
+
+const char *rimeStageName(RimeStage stage) {
+    switch (stage) {
+    case RimeStage::KeyEvent:
+        return "key_event";
+    case RimeStage::Compose:
+        return "compose";
+    case RimeStage::ProcessKey:
+        return "process_key";
+    case RimeStage::Commit:
+        return "commit";
+    case RimeStage::GetContext:
+        return "get_context";
+    case RimeStage::Preedit:
+        return "preedit";
+    case RimeStage::CandidateList:
+        return "candidate_list";
+    case RimeStage::UpdateUserInterface:
+        return "update_user_interface";
+    }
+    return "";
+}
+
+size_t RimeLatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < SubBuckets) {
+        return value;
+    }
+    // The highest bit decides the power of 2, the next 2 bits decide the
+    // sub bucket.
+    const size_t msb = std::bit_width(value) - 1;
+    const size_t sub = (value >> (msb - 2)) - SubBuckets;
+    return (msb - 1) * SubBuckets + sub;
+}
+
+uint64_t RimeLatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < SubBuckets) {
+        return index;
+    }
+    const size_t msb = index / SubBuckets + 1;
+    const uint64_t sub = index % SubBuckets;
+    const uint64_t lower = (SubBuckets + sub) << (msb - 2);
+    return lower + (uint64_t(1) << (msb - 2)) - 1;
+}
+
+void RimeLatencyHistogram::record(uint64_t value) {
+    buckets_[bucketIndex(value)] += 1;
+    count_ += 1;
+    max_ = std::max(max_, value);
+}
+
+uint64_t RimeLatencyHistogram::percentile(double quantile) const {
+    if (!count_) {
+        return 0;
+    }
+    const auto target = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(quantile * count_)));
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        accumulated += buckets_[i];
+        if (accumulated >= target) {
+            return std::min(bucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+RimeStageHistograms *RimeMetrics::histograms(const std::string &schema) {
+    if (!enabled_) {
+        return nullptr;
+    }
+    return &histograms_[schema];
+}
+
+std::vector<RimeLatencySummary> RimeMetrics::summary() const {
+    std::vector<RimeLatencySummary> result;
+    for (const auto &[schema, histograms] : histograms_) {
+        for (size_t i = 0; i < histograms.size(); i++) {
+            const auto &histogram = histograms[i];
+            if (!histogram.count()) {
+                continue;
+            }
+            result.push_back({schema, static_cast<RimeStage>(i),
+                              histogram.count(), histogram.percentile(0.5),
+                              histogram.percentile(0.95),
+                              histogram.percentile(0.99), histogram.max()});
+        }
+    }
+    return result;
+}
+
+void RimeMetrics::clear() {
+    histograms_.clear();
+    commits_.clear();
+    candidateStats_ = {};
+}
+
+void RimeMetrics::recordCommit(const std::string &schema) {
+    if (enabled_) {
+        commits_[schema] += 1;
+    }
+}
+
+void RimeMetrics::recordCandidateList(size_t size) {
+    if (!enabled_) {
+        return;
+    }
+    candidateStats_.lists += 1;
+    candidateStats_.candidates += size;
+    candidateStats_.maxCandidates =
+        std::max<uint64_t>(candidateStats_.maxCandidates, size);
+}
+
+void RimeMetrics::recordGlobalCandidate() {
+    if (enabled_) {
+        candidateStats_.globalCandidates += 1;
+    }
+}
+
+std::vector<RimeSchemaUsage> RimeMetrics::schemaUsage() const {
+    std::vector<RimeSchemaUsage> result;
+    for (const auto &[schema, histograms] : histograms_) {
+        uint64_t commits = 0;
+        if (auto iter = commits_.find(schema); iter != commits_.end()) {
+            commits = iter->second;
+        }
+        result.push_back(
+            {schema,
+             histograms[static_cast<size_t>(RimeStage::KeyEvent)].count(),
+             commits});
+    }
+    return result;
+}
+
+void RimeLatencyBudget::setBudget(uint64_t budget) {
+    if (budget_ != budget) {
+        budget_ = budget;
+        states_.clear();
+    }
+}
+
+uint64_t RimeLatencyBudget::budget(const std::string &schema) const {
+    auto iter = schemaBudgets_.find(schema);
+    return iter != schemaBudgets_.end() ? iter->second : budget_;
+}
+
+void RimeLatencyBudget::setSchemaBudgets(
+    std::unordered_map<std::string, uint64_t> budgets) {
+    if (schemaBudgets_ != budgets) {
+        schemaBudgets_ = std::move(budgets);
+        states_.clear();
+    }
+}
+
+bool RimeLatencyBudget::record(const std::string &schema, uint64_t latency) {
+    const auto budget = this->budget(schema);
+    if (!budget) {
+        return false;
+    }
+    // Weight of the latest sample, a single slow key won't degrade.
+    constexpr double alpha = 0.2;
+    auto &state = states_[schema];
+    state.average = alpha * latency + (1 - alpha) * state.average;
+    const double threshold = state.degraded ? budget / 2.0 : budget;
+    const bool degraded = state.average > threshold;
+    return std::exchange(state.degraded, degraded) != degraded;
+}
+
+bool RimeLatencyBudget::degraded(const std::string &schema) const {
+    if (!budget(schema)) {
+        return false;
+    }
+    auto iter = states_.find(schema);
+    return iter != states_.end() && iter->second.degraded;
+}
+
+RimeMemoryUsage RimeMemoryUsage::current() {
+    RimeMemoryUsage usage;
+    // size resident shared text lib data dt, in pages.
+    std::ifstream statm("/proc/self/statm");
+    int64_t size = 0;
+    int64_t resident = 0;
+    if (statm >> size >> resident) {
+        usage.rss = resident * sysconf(_SC_PAGESIZE);
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    usage.heap = static_cast<int64_t>(mallinfo2().uordblks);
+#endif
+    return usage;
+}
+
+void RimeMemoryStats::record(const std::string &name,
+                             const RimeMemoryUsage &before) {
+    const auto after = RimeMemoryUsage::current();
+    const RimeMemoryUsage delta{after.rss - before.rss,
+                                after.heap - before.heap};
+    auto &total = totals_[name];
+    if (!total.count) {
+        total.first = delta;
+    }
+    total.count += 1;
+    total.sum.rss += delta.rss;
+    total.sum.heap += delta.heap;
+}
+
+std::vector<RimeMemoryCost> RimeMemoryStats::costs() const {
+    std::vector<RimeMemoryCost> result;
+    for (const auto &[name, total] : totals_) {
+        const auto count = static_cast<int64_t>(total.count);
+        result.push_back(
+            {name,
+             total.count,
+             total.first,
+             {total.sum.rss / count, total.sum.heap / count}});
+    }
+    std::sort(result.begin(), result.end(),
+              [](const RimeMemoryCost &lhs, const RimeMemoryCost &rhs) {
+                  return lhs.name < rhs.name;
+              });
+    return result;
+}
+
+uint64_t RimeMetrics::timestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,271 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEMETRICS_H_
+#define _FCITX_RIMEMETRICS_H_
+
+#include "rimetracing.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+// Stages of a key event, KeyEvent covers the whole RimeState::keyEvent.
+enum class RimeStage {
+    KeyEvent,
+    Compose,
+    ProcessKey,
+    Commit,
+    GetContext,
+    Preedit,
+    CandidateList,
+    UpdateUserInterface,
+};
+
+constexpr size_t RimeStageCount =
+    static_cast<size_t>(RimeStage::UpdateUserInterface) + 1;
+
+const char *rimeStageName(RimeStage stage);
+
+// Histogram with 4 buckets for every power of 2, values are in nanoseconds.
+class RimeLatencyHistogram {
+public:
+    static constexpr size_t SubBuckets = 4;
+    static constexpr size_t NumBuckets = 64 * SubBuckets;
+
+    void record(uint64_t value);
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    // Upper bound of the bucket that contains the quantile.
+    uint64_t percentile(double quantile) const;
+    const std::array<uint64_t, NumBuckets> &buckets() const {
+        return buckets_;
+    }
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    std::array<uint64_t, NumBuckets> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+using RimeStageHistograms =
+    std::array<RimeLatencyHistogram, RimeStageCount>;
+
+struct RimeLatencySummary {
+    std::string schema;
+    RimeStage stage;
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+};
+
+struct RimeSchemaUsage {
+    std::string schema;
+    uint64_t keyEvents;
+    uint64_t commits;
+};
+
+struct RimeCandidateStats {
+    // Number of candidate lists built and candidates on them.
+    uint64_t lists = 0;
+    uint64_t candidates = 0;
+    uint64_t maxCandidates = 0;
+    // Number of candidates fetched with candidateFromAll.
+    uint64_t globalCandidates = 0;
+};
+
+class RimeMetrics {
+public:
+    bool enabled() const { return enabled_; }
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    void clear();
+
+    // Return nullptr if metrics is not enabled.
+    RimeStageHistograms *histograms(const std::string &schema);
+    const auto &allHistograms() const { return histograms_; }
+    std::vector<RimeLatencySummary> summary() const;
+
+    void recordCommit(const std::string &schema);
+    void recordCandidateList(size_t size);
+    void recordGlobalCandidate();
+    std::vector<RimeSchemaUsage> schemaUsage() const;
+    const RimeCandidateStats &candidateStats() const {
+        return candidateStats_;
+    }
+
+    static uint64_t timestamp();
+
+private:
+    bool enabled_ = false;
+    std::unordered_map<std::string, RimeStageHistograms> histograms_;
+    std::unordered_map<std::string, uint64_t> commits_;
+    RimeCandidateStats candidateStats_;
+};
+
+// Resident set size and bytes allocated by malloc of the process, heap is 0
+// if it is unknown.
+struct RimeMemoryUsage {
+    int64_t rss = 0;
+    int64_t heap = 0;
+
+    static RimeMemoryUsage current();
+};
+
+struct RimeMemoryCost {
+    std::string name;
+    uint64_t count;
+    // Change of memory usage in bytes, of the first time and on average.
+    RimeMemoryUsage first;
+    RimeMemoryUsage average;
+};
+
+// Memory usage change around creating sessions and selecting schemas. The
+// first time a schema is selected includes loading its dictionaries.
+class RimeMemoryStats {
+public:
+    bool enabled() const { return enabled_; }
+    void setEnabled(bool enabled) { enabled_ = enabled; }
+    void clear() { totals_.clear(); }
+
+    void record(const std::string &name, const RimeMemoryUsage &before);
+    std::vector<RimeMemoryCost> costs() const;
+
+private:
+    struct Total {
+        uint64_t count = 0;
+        RimeMemoryUsage first;
+        RimeMemoryUsage sum;
+    };
+
+    bool enabled_ = false;
+    std::unordered_map<std::string, Total> totals_;
+};
+
+// Record the memory usage change in the scope, if stats is enabled.
+class RimeMemoryWatch {
+public:
+    RimeMemoryWatch(RimeMemoryStats &stats, std::string name)
+        : stats_(stats), name_(std::move(name)) {
+        if (stats_.enabled()) {
+            before_ = RimeMemoryUsage::current();
+        }
+    }
+
+    // The name is prefix followed by suffix, only built if stats is enabled.
+    RimeMemoryWatch(RimeMemoryStats &stats, std::string_view prefix,
+                    std::string_view suffix)
+        : stats_(stats) {
+        if (stats_.enabled()) {
+            name_.reserve(prefix.size() + suffix.size());
+            name_.append(prefix).append(suffix);
+            before_ = RimeMemoryUsage::current();
+        }
+    }
+
+    RimeMemoryWatch(const RimeMemoryWatch &) = delete;
+
+    ~RimeMemoryWatch() {
+        if (stats_.enabled()) {
+            stats_.record(name_, before_);
+        }
+    }
+
+private:
+    RimeMemoryStats &stats_;
+    std::string name_;
+    RimeMemoryUsage before_;
+};
+
+// Track the latency of processing a key per schema against a budget. A
+// schema is degraded once the moving average exceeds the budget, and
+// recovers when it drops below half of the budget.
+class RimeLatencyBudget {
+public:
+    // Whether any schema has a budget.
+    bool enabled() const { return budget_ || !schemaBudgets_.empty(); }
+    // Budget of schema in nanoseconds, 0 if disabled.
+    uint64_t budget(const std::string &schema) const;
+    // Budget for schemas that don't have one of their own, 0 to disable.
+    void setBudget(uint64_t budget);
+    void setSchemaBudgets(std::unordered_map<std::string, uint64_t> budgets);
+
+    // Return true if the degraded state of schema is changed.
+    bool record(const std::string &schema, uint64_t latency);
+    bool degraded(const std::string &schema) const;
+
+private:
+    struct State {
+        double average = 0;
+        bool degraded = false;
+    };
+
+    uint64_t budget_ = 0;
+    std::unordered_map<std::string, uint64_t> schemaBudgets_;
+    std::unordered_map<std::string, State> states_;
+};
+
+inline void recordStage(RimeStageHistograms *histograms, RimeStage stage,
+                        uint64_t value) {
+    if (histograms) {
+        (*histograms)[static_cast<size_t>(stage)].record(value);
+    }
+}
+
+// Record the time spent in the scope into histograms and the trace, do
+// nothing if histograms is null and tracing is off.
+// The time is also stored to duration, if it is not null.
+class RimeStageTimer {
+public:
+    RimeStageTimer(RimeStageHistograms *histograms, RimeStage stage,
+                   std::optional<uint64_t> *duration = nullptr)
+        : RimeStageTimer(histograms, stage,
+                         histograms || duration || RimeTraceRecorder::current()
+                             ? RimeMetrics::timestamp()
+                             : 0,
+                         duration) {}
+    RimeStageTimer(RimeStageHistograms *histograms, RimeStage stage,
+                   uint64_t start, std::optional<uint64_t> *duration = nullptr)
+        : histograms_(histograms), stage_(stage), start_(start),
+          duration_(duration) {}
+
+    RimeStageTimer(const RimeStageTimer &) = delete;
+
+    ~RimeStageTimer() {
+        auto *trace = RimeTraceRecorder::current();
+        if (!histograms_ && !trace && !duration_) {
+            return;
+        }
+        const auto duration = RimeMetrics::timestamp() - start_;
+        recordStage(histograms_, stage_, duration);
+        if (trace) {
+            trace->slice(rimeStageName(stage_), start_, duration);
+        }
+        if (duration_) {
+            *duration_ = duration;
+        }
+    }
+
+private:
+    RimeStageHistograms *histograms_;
+    RimeStage stage_;
+    uint64_t start_;
+    std::optional<uint64_t> *duration_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEMETRICS_H_
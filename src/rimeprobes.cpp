@@ -0,0 +1,15 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimeprobes.h"
+
+#ifndef FCITX_RIME_NO_USDT
+// A tracer increases the semaphore of a probe when it attaches to it.
+#define RIME_PROBE_DEFINE_SEMAPHORE(name)                                      \
+    unsigned short RIME_PROBE_SEMAPHORE(name)                                  \
+        __attribute__((section(".probes"))) = 0;
+RIME_PROBES(RIME_PROBE_DEFINE_SEMAPHORE)
+#endif
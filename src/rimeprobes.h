@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEPROBES_H_
+#define _FCITX_RIMEPROBES_H_
+
+// USDT probes under provider fcitx5_rime, e.g. with bpftrace:
+//   bpftrace -e 'usdt:/path/to/rime.so:fcitx5_rime:key_start { ... }'
+//
+// key_start(session, schema, keysym, states, release)
+// key_end(session, schema, keysym, filtered)
+// api_entry(session, call), api_return(session, call)
+// panel_start(session), panel_end(session, candidates)
+// ui_start(session), ui_end(session, sent)
+// commit(session, length)
+// request_session(key, created)
+// session_create(session, program), session_destroy(session)
+// deploy_start(kind), deploy_finish(kind, success, duration_us)
+// notification(session, type, value)
+//
+// In an update of the UI, panel_start and panel_end cover building the
+// preedit and candidates from the context of rime, and ui_start and ui_end
+// cover sending them to the frontend. sent is false if nothing changed.
+//
+// Arguments of a disabled probe are still evaluated, so they must be cheap,
+// or the probe should be guarded with RIME_PROBE_ENABLED(name), which is only
+// true while a tracer is attached.
+
+#define RIME_PROBES(X)                                                         \
+    X(key_start)                                                               \
+    X(key_end)                                                                 \
+    X(api_entry)                                                               \
+    X(api_return)                                                              \
+    X(panel_start)                                                             \
+    X(panel_end)                                                               \
+    X(ui_start)                                                                \
+    X(ui_end)                                                                  \
+    X(commit)                                                                  \
+    X(request_session)                                                         \
+    X(session_create)                                                          \
+    X(session_destroy)                                                         \
+    X(deploy_start)                                                            \
+    X(deploy_finish)                                                           \
+    X(notification)
+
+#ifndef FCITX_RIME_NO_USDT
+// Every probe gets a semaphore, defined in rimeprobes.cpp.
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define RIME_PROBE_SEMAPHORE(name) fcitx5_rime_##name##_semaphore
+#define RIME_PROBE_DECLARE_SEMAPHORE(name)                                     \
+    extern "C" unsigned short RIME_PROBE_SEMAPHORE(name);
+RIME_PROBES(RIME_PROBE_DECLARE_SEMAPHORE)
+#define RIME_PROBE(name, ...) STAP_PROBEV(fcitx5_rime, name, __VA_ARGS__)
+#define RIME_PROBE_ENABLED(name)                                               \
+    __builtin_expect(RIME_PROBE_SEMAPHORE(name) != 0, 0)
+#else
+#define RIME_PROBE(name, ...)                                                  \
+    do {                                                                       \
+    } while (0)
+#define RIME_PROBE_ENABLED(name) false
+#endif
+
+#endif // _FCITX_RIMEPROBES_H_
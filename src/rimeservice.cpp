@@ -6,8 +6,25 @@
  */
 #include "rimeservice.h"
 #include "dbus_public.h"
+#include "rimeaction.h"
 #include "rimeengine.h"
+#include "rimemetrics.h"
 #include "rimestate.h"
+#include "rimewatchdog.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fcitx-utils/dbus/objectvtable.h>
+#include <fcitx-utils/event.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputcontextmanager.h>
+#include <rime_api.h>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace fcitx::rime {
 
@@ -71,17 +88,314 @@ std::string RimeService::currentSchema() {
 
 std::vector<std::string> RimeService::listAllSchemas() {
     std::vector<std::string> schemas;
-    if (auto api = engine_->api()) {
-        RimeSchemaList list;
-        list.size = 0;
-        if (api->get_schema_list(&list)) {
-            for (size_t i = 0; i < list.size; i++) {
-                schemas.emplace_back(list.list[i].schema_id);
+    // Updated after every deployment.
+    for (const auto &[schema, name] : engine_->schemaList()) {
+        schemas.push_back(schema);
+    }
+    return schemas;
+}
+
+std::tuple<RimeService::SessionInfos, RimeService::SchemaInfos>
+RimeService::allSessions() {
+    // Option names of each schema, their order defines the bits of a
+    // session's options.
+    std::unordered_map<std::string, std::vector<std::string>> schemaOptions;
+    SchemaInfos schemas;
+    for (const auto &[schema, name] : engine_->schemaList()) {
+        auto &options = schemaOptions[schema];
+        auto iter = engine_->optionActions().find(schema);
+        if (iter != engine_->optionActions().end()) {
+            for (const auto &action : iter->second) {
+                if (const auto *toggle =
+                        dynamic_cast<const ToggleAction *>(action.get())) {
+                    options.push_back(toggle->option());
+                } else if (const auto *select =
+                               dynamic_cast<const SelectAction *>(
+                                   action.get())) {
+                    options.insert(options.end(), select->options().begin(),
+                                   select->options().end());
+                }
             }
-            api->free_schema_list(&list);
         }
+        if (options.size() > 64) {
+            options.resize(64);
+        }
+        schemas.emplace_back(schema, name, options);
+    }
+
+    std::unordered_map<RimeSessionId, std::vector<std::string>> programs;
+    engine_->instance()->inputContextManager().foreach(
+        [this, &programs](InputContext *ic) {
+            if (auto *state = engine_->state(ic)) {
+                if (auto session = state->session(false)) {
+                    programs[session].push_back(ic->program());
+                }
+            }
+            return true;
+        });
+
+    SessionInfos sessions;
+    engine_->worker().drain();
+    auto *api = engine_->api();
+    RimeCallWatch watch(engine_->watchdog(), api, "get_all_sessions", 0);
+    for (const auto &[key, weakHolder] : engine_->sessionPool().sessions()) {
+        auto holder = weakHolder.lock();
+        if (!holder) {
+            continue;
+        }
+        const auto session = holder->id();
+        std::string schema;
+        bool asciiMode = false;
+        RIME_STRUCT(RimeStatus, status);
+        if (api->get_status(session, &status)) {
+            schema = status.schema_id ? status.schema_id : "";
+            asciiMode = status.is_ascii_mode;
+            api->free_status(&status);
+        }
+        uint64_t options = 0;
+        if (auto iter = schemaOptions.find(schema);
+            iter != schemaOptions.end()) {
+            for (size_t i = 0; i < iter->second.size(); i++) {
+                if (api->get_option(session, iter->second[i].c_str())) {
+                    options |= 1ULL << i;
+                }
+            }
+        }
+        sessions.emplace_back(key, programs[session], schema, asciiMode,
+                              options);
+    }
+    return {std::move(sessions), std::move(schemas)};
+}
+
+RimeService::LatencySummary RimeService::latencySummary() {
+    LatencySummary result;
+    for (const auto &item : engine_->metrics().summary()) {
+        result.emplace_back(item.schema, rimeStageName(item.stage), item.count,
+                            item.p50, item.p95, item.p99, item.max);
+    }
+    return result;
+}
+
+RimeService::LatencyHistograms RimeService::latencyHistograms() {
+    LatencyHistograms result;
+    for (const auto &[schema, histograms] :
+         engine_->metrics().allHistograms()) {
+        for (size_t i = 0; i < histograms.size(); i++) {
+            const auto &histogram = histograms[i];
+            if (!histogram.count()) {
+                continue;
+            }
+            // Only non-empty buckets, as (upper bound, count).
+            std::vector<dbus::DBusStruct<uint64_t, uint64_t>> buckets;
+            const auto &counts = histogram.buckets();
+            for (size_t j = 0; j < counts.size(); j++) {
+                if (counts[j]) {
+                    buckets.emplace_back(
+                        RimeLatencyHistogram::bucketUpperBound(j), counts[j]);
+                }
+            }
+            result.emplace_back(schema,
+                                rimeStageName(static_cast<RimeStage>(i)),
+                                std::move(buckets));
+        }
+    }
+    return result;
+}
+
+RimeService::SchemaUsage RimeService::schemaUsage() {
+    SchemaUsage result;
+    for (const auto &item : engine_->metrics().schemaUsage()) {
+        result.emplace_back(item.schema, item.keyEvents, item.commits);
+    }
+    return result;
+}
+
+std::tuple<uint32_t, uint32_t> RimeService::sessionStats() {
+    return {static_cast<uint32_t>(engine_->sessionPool().size()),
+            engine_->attachedInputContexts()};
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t, uint64_t>
+RimeService::candidateStats() {
+    const auto &stats = engine_->metrics().candidateStats();
+    return {stats.lists, stats.candidates, stats.maxCandidates,
+            stats.globalCandidates};
+}
+
+std::tuple<uint64_t, uint64_t, uint64_t, uint64_t> RimeService::updateStats() {
+    const auto &counters = engine_->updateCounters();
+    return {counters.preeditSent, counters.preeditSkipped, counters.panelSent,
+            counters.panelSkipped};
+}
+
+uint32_t RimeService::notificationQueueDepth() {
+    return engine_->pendingNotifications();
+}
+
+std::tuple<uint64_t, uint64_t> RimeService::maintenanceStats() {
+    return {engine_->lastDeployDuration(), engine_->lastSyncDuration()};
+}
+
+std::tuple<int64_t, int64_t, RimeService::MemoryCosts>
+RimeService::memoryStats() {
+    MemoryCosts costs;
+    for (const auto &cost : engine_->memoryStats().costs()) {
+        costs.emplace_back(cost.name, cost.count, cost.first.rss,
+                           cost.first.heap, cost.average.rss,
+                           cost.average.heap);
+    }
+    const auto usage = RimeMemoryUsage::current();
+    return {usage.rss, usage.heap, std::move(costs)};
+}
+
+RimeService::SlowCalls RimeService::slowCalls() {
+    SlowCalls result;
+    for (const auto &call : engine_->watchdog().slowCalls()) {
+        result.emplace_back(call.call, call.schema, call.session, call.keysym,
+                            call.inputLength, call.elapsed, call.time,
+                            call.finished);
+    }
+    return result;
+}
+
+bool RimeService::startTrace(const std::string &path) {
+    return engine_->startTrace(path);
+}
+
+std::string RimeService::stopTrace() { return engine_->stopTrace(); }
+
+std::vector<std::vector<std::string>>
+RimeService::convert(const std::string &schema,
+                     const std::vector<std::string> &inputs, uint32_t limit) {
+    constexpr uint32_t MaxCandidates = 100;
+    // Short enough not to delay typing, callers can split larger ones.
+    constexpr size_t MaxInputs = 32;
+    if (inputs.size() > MaxInputs) {
+        throw dbus::MethodCallError(
+            "org.freedesktop.DBus.Error.InvalidArgs",
+            "Too many inputs, at most " + std::to_string(MaxInputs) +
+                " can be converted in one call.");
+    }
+    if (engine_->api()->is_maintenance_mode()) {
+        throw dbus::MethodCallError("org.freedesktop.DBus.Error.Failed",
+                                    "Rime is under maintenance.");
+    }
+    if (!engine_->schemas().count(schema)) {
+        throw dbus::MethodCallError("org.freedesktop.DBus.Error.InvalidArgs",
+                                    "Invalid schema.");
+    }
+    // librime is not reentrant, let pending work finish before using it from
+    // main thread.
+    engine_->worker().drain();
+    RimeCallWatch watch(engine_->watchdog(), engine_->api(), "convert", 0,
+                        schema);
+    auto result = engine_->converter().convert(
+        schema, inputs, std::min(limit, MaxCandidates));
+    if (!result) {
+        throw dbus::MethodCallError("org.freedesktop.DBus.Error.InvalidArgs",
+                                    "Invalid schema.");
+    }
+    return std::move(*result);
+}
+
+void RimeService::setSnapshotInterval(int interval) {
+    snapshotTimer_.reset();
+    if (interval <= 0) {
+        return;
+    }
+    const uint64_t usec = static_cast<uint64_t>(interval) * 1000000;
+    snapshotTimer_ = engine_->instance()->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + usec, 0,
+        [this, usec](EventSourceTime *source, uint64_t) {
+            // Nothing is collected when metrics is disabled.
+            if (engine_->metrics().enabled()) {
+                auto [pool, attached] = sessionStats();
+                metricsSnapshot(latencySummary(), schemaUsage(), pool,
+                                attached);
+            }
+            source->setTime(now(CLOCK_MONOTONIC) + usec);
+            source->setOneShot();
+            return true;
+        });
+}
+
+void RimeService::notify(RimeSessionId session, const std::string &type,
+                         const std::string &value) {
+    auto &pending = pendingSignals_[session];
+    if (type == "schema") {
+        // schema_id/schema_name
+        pending.schema = value.substr(0, value.find('/'));
+    } else if (type == "option") {
+        // Disabled option is prefixed with "!".
+        const bool enabled = !value.starts_with('!');
+        auto option = enabled ? value : value.substr(1);
+        if (option == "ascii_mode") {
+            pending.asciiMode = enabled;
+        }
+        pending.options[std::move(option)] = enabled;
+    } else {
+        return;
+    }
+    scheduleSignals();
+}
+
+void RimeService::activate(RimeState *state) {
+    PendingSignals current;
+    // Runs on every focus change, don't wait for the worker.
+    if (!state->peekStatus([&current](const RimeStatus &status) {
+            current.schema = status.schema_id ? status.schema_id : "";
+            current.asciiMode = status.is_ascii_mode;
+        })) {
+        return;
+    }
+    auto &pending = pendingSignals_[state->session(false)];
+    pending.schema = std::move(current.schema);
+    pending.asciiMode = current.asciiMode;
+    scheduleSignals();
+}
+
+void RimeService::scheduleSignals() {
+    const auto deadline = lastSignalTime_ + SignalInterval;
+    if (signalTimer_) {
+        if (signalTimer_->isEnabled()) {
+            return;
+        }
+        signalTimer_->setTime(deadline);
+    } else {
+        signalTimer_ = engine_->instance()->eventLoop().addTimeEvent(
+            CLOCK_MONOTONIC, deadline, 0,
+            [this](EventSourceTime * /*unused*/, uint64_t /*unused*/) {
+                flushSignals();
+                return true;
+            });
+    }
+    signalTimer_->setOneShot();
+}
+
+void RimeService::flushSignals() {
+    lastSignalTime_ = now(CLOCK_MONOTONIC);
+    auto pendingSignals = std::move(pendingSignals_);
+    pendingSignals_.clear();
+    auto *state = currentState();
+    if (!state) {
+        return;
+    }
+    auto iter = pendingSignals.find(state->session(false));
+    if (iter == pendingSignals.end()) {
+        return;
+    }
+    auto &pending = iter->second;
+    if (pending.schema && pending.schema != lastSchema_) {
+        lastSchema_ = pending.schema;
+        schemaChanged(*pending.schema);
+    }
+    if (pending.asciiMode && pending.asciiMode != lastAsciiMode_) {
+        lastAsciiMode_ = pending.asciiMode;
+        asciiModeChanged(*pending.asciiMode);
+    }
+    for (const auto &[option, enabled] : pending.options) {
+        optionChanged(option, enabled);
     }
-    return schemas;
 }
 
 } // namespace fcitx::rime
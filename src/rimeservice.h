@@ -7,8 +7,18 @@
 #ifndef _FCITX5_RIME_RIMESERVICE_H_
 #define _FCITX5_RIME_RIMESERVICE_H_
 
+#include <cstdint>
 #include <fcitx-utils/dbus/message.h>
 #include <fcitx-utils/dbus/objectvtable.h>
+#include <fcitx-utils/eventloopinterface.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <rime_api.h>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace fcitx::rime {
 
@@ -25,15 +35,122 @@ public:
     std::string currentSchema();
     std::vector<std::string> listAllSchemas();
 
+    // Key, programs of attached input contexts, schema, ascii mode and
+    // options of a session. Bit i of options is the i-th option of the
+    // schema.
+    using SessionInfos =
+        std::vector<dbus::DBusStruct<std::string, std::vector<std::string>,
+                                     std::string, bool, uint64_t>>;
+    // Id, name and options of a schema.
+    using SchemaInfos =
+        std::vector<dbus::DBusStruct<std::string, std::string,
+                                     std::vector<std::string>>>;
+    std::tuple<SessionInfos, SchemaInfos> allSessions();
+
+    using LatencySummary =
+        std::vector<dbus::DBusStruct<std::string, std::string, uint64_t,
+                                     uint64_t, uint64_t, uint64_t, uint64_t>>;
+    using LatencyHistograms = std::vector<
+        dbus::DBusStruct<std::string, std::string,
+                         std::vector<dbus::DBusStruct<uint64_t, uint64_t>>>>;
+    using SchemaUsage =
+        std::vector<dbus::DBusStruct<std::string, uint64_t, uint64_t>>;
+
+    // Latencies are in nanoseconds, durations are in microseconds. Latency,
+    // schema usage and candidate statistics are only collected with
+    // LatencyMetrics.
+    LatencySummary latencySummary();
+    LatencyHistograms latencyHistograms();
+    SchemaUsage schemaUsage();
+    std::tuple<uint32_t, uint32_t> sessionStats();
+    std::tuple<uint64_t, uint64_t, uint64_t, uint64_t> candidateStats();
+    std::tuple<uint64_t, uint64_t, uint64_t, uint64_t> updateStats();
+    uint32_t notificationQueueDepth();
+    std::tuple<uint64_t, uint64_t> maintenanceStats();
+    // Current rss and heap, and the memory cost of sessions and schemas:
+    // name, count, first rss and heap, average rss and heap, in bytes.
+    using MemoryCosts =
+        std::vector<dbus::DBusStruct<std::string, uint64_t, int64_t, int64_t,
+                                     int64_t, int64_t>>;
+    std::tuple<int64_t, int64_t, MemoryCosts> memoryStats();
+    // Slow librime calls: call, schema, session, keysym, input length,
+    // elapsed us, time, and whether it has returned.
+    using SlowCalls = std::vector<
+        dbus::DBusStruct<std::string, std::string, uint64_t, uint32_t,
+                         uint32_t, uint64_t, uint64_t, bool>>;
+    SlowCalls slowCalls();
+    bool startTrace(const std::string &path);
+    std::string stopTrace();
+    // Top limit candidates of each input with a schema in the schema list.
+    // It blocks the main loop, so the number of inputs in one call is
+    // limited, and it fails while rime is under maintenance.
+    std::vector<std::vector<std::string>>
+    convert(const std::string &schema, const std::vector<std::string> &inputs,
+            uint32_t limit);
+
+    // Emit MetricsSnapshot every interval seconds, 0 to disable.
+    void setSnapshotInterval(int interval);
+
+    // Queue the change of an option or schema notification. Changes are
+    // coalesced per session, and emitted at most once every SignalInterval
+    // for the session of current input context.
+    void notify(RimeSessionId session, const std::string &type,
+                const std::string &value);
+    // Emit ascii mode and schema of a newly activated input context, if they
+    // differ from what was emitted last time.
+    void activate(RimeState *state);
+
 private:
+    static constexpr uint64_t SignalInterval = 100000;
+
+    struct PendingSignals {
+        std::optional<std::string> schema;
+        std::optional<bool> asciiMode;
+        std::map<std::string, bool> options;
+    };
+
     RimeState *currentState();
+    void scheduleSignals();
+    void flushSignals();
     FCITX_OBJECT_VTABLE_METHOD(setAsciiMode, "SetAsciiMode", "b", "");
     FCITX_OBJECT_VTABLE_METHOD(isAsciiMode, "IsAsciiMode", "", "b");
     FCITX_OBJECT_VTABLE_METHOD(setSchema, "SetSchema", "s", "");
     FCITX_OBJECT_VTABLE_METHOD(currentSchema, "GetCurrentSchema", "", "s");
     FCITX_OBJECT_VTABLE_METHOD(listAllSchemas, "ListAllSchemas", "", "as");
+    FCITX_OBJECT_VTABLE_METHOD(allSessions, "GetAllSessions", "",
+                               "a(sassbt)a(ssas)");
+    FCITX_OBJECT_VTABLE_METHOD(latencySummary, "GetLatencySummary", "",
+                               "a(ssttttt)");
+    FCITX_OBJECT_VTABLE_METHOD(latencyHistograms, "GetLatencyHistograms", "",
+                               "a(ssa(tt))");
+    FCITX_OBJECT_VTABLE_METHOD(schemaUsage, "GetSchemaUsage", "", "a(stt)");
+    FCITX_OBJECT_VTABLE_METHOD(sessionStats, "GetSessionStats", "", "uu");
+    FCITX_OBJECT_VTABLE_METHOD(candidateStats, "GetCandidateStats", "",
+                               "tttt");
+    FCITX_OBJECT_VTABLE_METHOD(updateStats, "GetUpdateStats", "", "tttt");
+    FCITX_OBJECT_VTABLE_METHOD(notificationQueueDepth,
+                               "GetNotificationQueueDepth", "", "u");
+    FCITX_OBJECT_VTABLE_METHOD(maintenanceStats, "GetMaintenanceStats", "",
+                               "tt");
+    FCITX_OBJECT_VTABLE_METHOD(memoryStats, "GetMemoryStats", "",
+                               "xxa(stxxxx)");
+    FCITX_OBJECT_VTABLE_METHOD(slowCalls, "GetSlowCalls", "", "a(sstuuttb)");
+    FCITX_OBJECT_VTABLE_METHOD(startTrace, "StartTrace", "s", "b");
+    FCITX_OBJECT_VTABLE_METHOD(stopTrace, "StopTrace", "", "s");
+    FCITX_OBJECT_VTABLE_METHOD(convert, "Convert", "sasu", "aas");
+    FCITX_OBJECT_VTABLE_SIGNAL(metricsSnapshot, "MetricsSnapshot",
+                               "a(ssttttt)a(stt)uu");
+    FCITX_OBJECT_VTABLE_SIGNAL(asciiModeChanged, "AsciiModeChanged", "b");
+    FCITX_OBJECT_VTABLE_SIGNAL(schemaChanged, "SchemaChanged", "s");
+    FCITX_OBJECT_VTABLE_SIGNAL(optionChanged, "OptionChanged", "sb");
 
     RimeEngine *engine_;
+    std::unique_ptr<EventSourceTime> snapshotTimer_;
+    std::unordered_map<RimeSessionId, PendingSignals> pendingSignals_;
+    std::unique_ptr<EventSourceTime> signalTimer_;
+    uint64_t lastSignalTime_ = 0;
+    std::optional<bool> lastAsciiMode_;
+    std::optional<std::string> lastSchema_;
 };
 
 } // namespace fcitx::rime
@@ -6,6 +6,9 @@
  */
 #include "rimesession.h"
 #include "rimeengine.h"
+#include "rimemetrics.h"
+#include "rimeprobes.h"
+#include "rimetracing.h"
 #include <cassert>
 #include <fcitx-utils/charutils.h>
 #include <fcitx-utils/log.h>
@@ -13,6 +16,7 @@
 #include <fcitx-utils/stringutils.h>
 #include <fcitx/inputcontext.h>
 #include <fcitx/inputcontextmanager.h>
+#include <functional>
 #include <memory>
 #include <rime_api.h>
 #include <stdexcept>
@@ -26,11 +30,13 @@ RimeSessionHolder::RimeSessionHolder(RimeSessionPool *pool,
                                      const std::string &program)
     : pool_(pool) {
     auto *api = pool_->engine()->api();
+    RimeMemoryWatch memoryWatch(pool_->engine()->memoryStats(), "session");
     id_ = api->create_session();
 
     if (!id_) {
         throw std::runtime_error("Failed to create session.");
     }
+    RIME_PROBE(session_create, id_, program.c_str());
 
     setProgramName(program);
 
@@ -50,6 +56,10 @@ RimeSessionHolder::RimeSessionHolder(RimeSessionPool *pool,
 
 RimeSessionHolder::~RimeSessionHolder() {
     if (id_) {
+        RIME_PROBE(session_destroy, id_);
+        // The worker may still be using some session, and librime's session
+        // map must not be changed at the same time.
+        pool_->engine()->worker().drain();
         pool_->engine()->api()->destroy_session(id_);
     }
     if (!key_.empty()) {
@@ -65,7 +75,17 @@ void RimeSessionHolder::setProgramName(const std::string &program) {
     }
 
     currentProgram_ = program;
-    pool_->engine()->api()->set_property(id_, "client_app", program.data());
+    auto *api = pool_->engine()->api();
+    auto &worker = pool_->engine()->worker();
+    if (!worker.idle()) {
+        // Keep the order with the keys in flight instead of waiting for them.
+        worker.post([api, session = id_, program]() -> std::function<void()> {
+            api->set_property(session, "client_app", program.data());
+            return {};
+        });
+        return;
+    }
+    api->set_property(id_, "client_app", program.data());
 }
 
 #if 0
@@ -121,8 +141,10 @@ RimeSessionPool::requestSession(InputContext *ic) {
     }
     auto iter = sessions_.find(key);
     if (iter != sessions_.end()) {
+        RIME_PROBE(request_session, key.c_str(), false);
         return {iter->second.lock(), false};
     }
+    RIME_PROBE(request_session, key.c_str(), true);
     try {
         auto newSession =
             std::make_shared<RimeSessionHolder>(this, ic->program());
@@ -140,12 +162,18 @@ void RimeSessionPool::registerSession(
     auto [_, success] = sessions_.emplace(key, session);
     FCITX_UNUSED(success);
     assert(success);
+    if (auto *trace = RimeTraceRecorder::current()) {
+        trace->counter("sessions", sessions_.size());
+    }
 }
 
 void RimeSessionPool::unregisterSession(const std::string &key) {
     auto count = sessions_.erase(key);
     FCITX_UNUSED(count);
     assert(count > 0);
+    if (auto *trace = RimeTraceRecorder::current()) {
+        trace->counter("sessions", sessions_.size());
+    }
 }
 
 } // namespace fcitx::rime
@@ -7,6 +7,7 @@
 #ifndef _FCITX5_RIME_RIMESESSION_H_
 #define _FCITX5_RIME_RIMESESSION_H_
 
+#include <cstddef>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/macros.h>
 #include <fcitx/inputcontext.h>
@@ -35,6 +36,7 @@ public:
     RimeSessionId id() const { return id_; }
 
     void setProgramName(const std::string &program);
+    const std::string &programName() const { return currentProgram_; }
 
 private:
     RimeSessionPool *pool_;
@@ -56,6 +58,8 @@ public:
     requestSession(InputContext *ic);
 
     RimeEngine *engine() const { return engine_; }
+    size_t size() const { return sessions_.size(); }
+    const auto &sessions() const { return sessions_; }
 
 private:
     void registerSession(const std::string &key,
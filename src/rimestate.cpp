@@ -8,11 +8,17 @@
 #include "rimeaction.h"
 #include "rimecandidate.h"
 #include "rimeengine.h"
+#include "rimemetrics.h"
+#include "rimeprobes.h"
 #include "rimesession.h"
+#include "rimetracing.h"
+#include "rimewatchdog.h"
 #include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <fcitx-utils/capabilityflags.h>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/eventloopinterface.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
@@ -40,18 +46,146 @@
 
 namespace fcitx::rime {
 
-namespace {} // namespace
+namespace {
+
+// FNV-1a, only used to tell whether the content of the panel is changed.
+class Fingerprint {
+public:
+    void add(uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            addByte(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    void add(std::string_view str) {
+        add(static_cast<uint64_t>(str.size()));
+        for (char c : str) {
+            addByte(static_cast<uint8_t>(c));
+        }
+    }
+
+    void add(const Text &text) {
+        add(static_cast<uint64_t>(text.size()));
+        for (size_t i = 0; i < text.size(); i++) {
+            add(text.stringAt(i));
+            add(static_cast<uint64_t>(
+                static_cast<uint32_t>(text.formatAt(i))));
+        }
+        add(static_cast<uint64_t>(text.cursor()));
+    }
+
+    uint64_t value() const { return value_; }
+
+private:
+    void addByte(uint8_t byte) {
+        value_ ^= byte;
+        value_ *= 0x100000001b3ULL;
+    }
+
+    uint64_t value_ = 0xcbf29ce484222325ULL;
+};
+
+uint64_t preeditFingerprint(const InputPanel &inputPanel) {
+    Fingerprint fingerprint;
+    fingerprint.add(inputPanel.clientPreedit());
+    return fingerprint.value();
+}
+
+uint64_t panelFingerprint(const InputPanel &inputPanel) {
+    Fingerprint fingerprint;
+    fingerprint.add(inputPanel.preedit());
+    fingerprint.add(inputPanel.auxUp());
+    fingerprint.add(inputPanel.auxDown());
+    const auto &candidateList = inputPanel.candidateList();
+    if (!candidateList) {
+        fingerprint.add(static_cast<uint64_t>(0));
+        return fingerprint.value();
+    }
+    fingerprint.add(static_cast<uint64_t>(candidateList->size()) + 1);
+    for (int i = 0; i < candidateList->size(); i++) {
+        fingerprint.add(candidateList->label(i));
+        fingerprint.add(candidateList->candidate(i).text());
+        fingerprint.add(candidateList->candidate(i).comment());
+    }
+    fingerprint.add(static_cast<uint64_t>(candidateList->cursorIndex()));
+    fingerprint.add(static_cast<uint64_t>(candidateList->layoutHint()));
+    if (const auto *pageable = candidateList->toPageable()) {
+        fingerprint.add(static_cast<uint64_t>(pageable->hasPrev()));
+        fingerprint.add(static_cast<uint64_t>(pageable->hasNext()));
+    }
+    return fingerprint.value();
+}
+
+// Fill the commit and snapshots of a call made on the worker thread.
+void collectResult(rime_api_t *api, RimeSessionId session,
+                   RimeKeyResult &result) {
+    RIME_STRUCT(RimeCommit, commit);
+    if (api->get_commit(session, &commit)) {
+        result.commit = commit.text;
+        api->free_commit(&commit);
+    }
+    RIME_STRUCT(RimeContext, context);
+    if (api->get_context(session, &context)) {
+        result.context = std::make_shared<RimeContextSnapshot>(context);
+        api->free_context(&context);
+    }
+    RIME_STRUCT(RimeStatus, status);
+    if (api->get_status(session, &status)) {
+        result.status = std::make_shared<RimeStatusSnapshot>(status);
+        api->free_status(&status);
+    }
+}
+
+// Fire key_end on every way out of RimeState::keyEvent.
+class KeyEventProbe {
+public:
+    KeyEventProbe(RimeState *state, RimeSessionId session,
+                  const KeyEvent &event)
+        : state_(state), session_(session), event_(event) {
+        // cachedSchema may query librime, only do it for a tracer.
+        if (RIME_PROBE_ENABLED(key_start)) {
+            RIME_PROBE(key_start, session_, state_->cachedSchema().c_str(),
+                       event_.rawKey().sym(),
+                       static_cast<uint32_t>(event_.rawKey().states()),
+                       event_.isRelease());
+        }
+    }
+
+    KeyEventProbe(const KeyEventProbe &) = delete;
+
+    ~KeyEventProbe() {
+        if (RIME_PROBE_ENABLED(key_end)) {
+            RIME_PROBE(key_end, session_, state_->cachedSchema().c_str(),
+                       event_.rawKey().sym(), event_.filtered());
+        }
+    }
+
+private:
+    [[maybe_unused]] RimeState *state_;
+    [[maybe_unused]] RimeSessionId session_;
+    [[maybe_unused]] const KeyEvent &event_;
+};
+
+} // namespace
 
 RimeState::RimeState(RimeEngine *engine, InputContext &ic)
     : engine_(engine), ic_(ic) {}
 
-RimeState::~RimeState() {}
+RimeState::~RimeState() {
+    // Keys still in flight are dropped, the session holder waits for the
+    // worker before destroying the session.
+    alive_.reset();
+}
 
 RimeSessionId RimeState::session(bool requestNewSession) {
     if (!session_ && requestNewSession) {
+        // Creating a session changes librime's session map.
+        engine_->worker().drain();
         auto [sessionHolder, isNewSession] =
             engine_->sessionPool().requestSession(&ic_);
         session_ = sessionHolder;
+        lastModeOutdated_ = true;
+        cachedSchemaSerial_.reset();
         if (isNewSession) {
             restore();
         } else {
@@ -66,8 +200,19 @@ RimeSessionId RimeState::session(bool requestNewSession) {
     return session_->id();
 }
 
+RimeSessionId RimeState::syncSession(bool requestNewSession) {
+    engine_->worker().drain();
+    dropSnapshots();
+    return session(requestNewSession);
+}
+
+void RimeState::dropSnapshots() {
+    contextSnapshot_.reset();
+    statusSnapshot_.reset();
+}
+
 void RimeState::clear() {
-    if (auto session = this->session()) {
+    if (auto session = this->syncSession()) {
         engine_->api()->clear_composition(session);
     }
 }
@@ -80,10 +225,24 @@ std::string RimeState::asciiModeName(bool abbrev) {
         result = engine_->isCapsLockOn(&ic_) ? "ABC" : "abc";
     }
     if (engine_->config().latinModeNameFromSchema.value()) {
-        RimeStringSlice label = engine_->api()->get_state_label_abbreviated(
-            session(), "ascii_mode", True, abbrev);
-        if (label.str && label.length > 0) {
-            result.assign(label.str, label.length);
+        // Labels only change with schema, which comes with a notification.
+        // Keep the old ones while the worker is busy.
+        if (asciiModeLabelsSerial_ != engine_->notificationSerial() &&
+            (!asciiModeLabels_ || engine_->worker().idle())) {
+            auto label = [this](bool abbreviated) {
+                RimeStringSlice slice =
+                    engine_->api()->get_state_label_abbreviated(
+                        syncSession(), "ascii_mode", True, abbreviated);
+                return slice.str ? std::string(slice.str, slice.length)
+                                 : std::string();
+            };
+            asciiModeLabels_.emplace(label(false), label(true));
+            asciiModeLabelsSerial_ = engine_->notificationSerial();
+        }
+        const auto &label =
+            abbrev ? asciiModeLabels_->second : asciiModeLabels_->first;
+        if (!label.empty()) {
+            result = label;
         }
     }
     return result;
@@ -124,6 +283,15 @@ std::string RimeState::subModeLabel() {
     return result;
 }
 
+const std::string &RimeState::cachedSchema() {
+    // Schema can only be changed with a notification.
+    if (cachedSchemaSerial_ != engine_->notificationSerial()) {
+        cachedSchema_ = currentSchema();
+        cachedSchemaSerial_ = engine_->notificationSerial();
+    }
+    return cachedSchema_;
+}
+
 std::string RimeState::currentSchema() {
     std::string schema;
     getStatus([&schema](const RimeStatus &status) {
@@ -140,8 +308,10 @@ void RimeState::toggleLatinMode() {
         return;
     }
 
-    Bool oldValue = api->get_option(session(), RIME_ASCII_MODE);
-    api->set_option(session(), RIME_ASCII_MODE, !oldValue);
+    auto session = this->syncSession();
+    Bool oldValue = api->get_option(session, RIME_ASCII_MODE);
+    api->set_option(session, RIME_ASCII_MODE, !oldValue);
+    lastModeOutdated_ = true;
 }
 
 void RimeState::setLatinMode(bool latin) {
@@ -149,7 +319,8 @@ void RimeState::setLatinMode(bool latin) {
     if (api->is_maintenance_mode()) {
         return;
     }
-    api->set_option(session(), RIME_ASCII_MODE, latin);
+    api->set_option(syncSession(), RIME_ASCII_MODE, latin);
+    lastModeOutdated_ = true;
 }
 
 void RimeState::selectSchema(const std::string &schema) {
@@ -157,13 +328,25 @@ void RimeState::selectSchema(const std::string &schema) {
     if (api->is_maintenance_mode()) {
         return;
     }
-    api->set_option(session(), RIME_ASCII_MODE, false);
-    api->select_schema(session(), schema.data());
+    auto session = this->syncSession();
+    api->set_option(session, RIME_ASCII_MODE, false);
+    RimeCallWatch watch(engine_->watchdog(), api, "select_schema", session,
+                        schema);
+    RimeMemoryWatch memoryWatch(engine_->memoryStats(), "schema:", schema);
+    api->select_schema(session, schema.data());
+    lastModeOutdated_ = true;
+    cachedSchemaSerial_.reset();
 }
 
 void RimeState::keyEvent(KeyEvent &event) {
-    changedOptions_.clear();
+    if (!updatePending_) {
+        changedOptions_.clear();
+    }
     auto *ic = event.inputContext();
+    auto *trace = RimeTraceRecorder::current();
+    const bool budget = engine_->latencyBudget().enabled();
+    const bool measure = engine_->metrics().enabled() || trace || budget;
+    const auto keyEventStart = measure ? RimeMetrics::timestamp() : 0;
     // For key-release, composeResult will always be empty string, which feed
     // into engine directly.
     std::string composeResult;
@@ -178,23 +361,57 @@ void RimeState::keyEvent(KeyEvent &event) {
         }
         composeResult = *compose;
     }
+    const auto composeEnd = measure ? RimeMetrics::timestamp() : 0;
 
     auto *api = engine_->api();
     if (api->is_maintenance_mode()) {
         return;
     }
+    const bool async = engine_->worker().running();
     auto session = this->session();
     if (!session) {
         return;
     }
 
-    maybeSyncProgramNameToSession();
-    lastMode_ = subMode();
-
-    std::string lastSchema = currentSchema();
+    KeyEventProbe probe(this, session, event);
+    auto *histograms = measure ? stageHistograms() : nullptr;
+    RimeStageTimer keyEventTimer(histograms, RimeStage::KeyEvent,
+                                 keyEventStart);
+    if (!event.isRelease()) {
+        recordStage(histograms, RimeStage::Compose,
+                    composeEnd - keyEventStart);
+        if (trace) {
+            trace->slice(rimeStageName(RimeStage::Compose), keyEventStart,
+                         composeEnd - keyEventStart, "keysym",
+                         event.rawKey().sym());
+        }
+    }
     auto states = event.rawKey().states() &
                   KeyStates{KeyState::Mod1, KeyState::CapsLock, KeyState::Shift,
                             KeyState::Ctrl, KeyState::Super};
+    // Keys that are not handled by rime must not overtake the keys that are
+    // still processed by the worker.
+    if (composeResult.empty() && !composing_ && !inFlight_ &&
+        !engine_->isKeyInteresting(cachedSchema(),
+                                   Key(event.rawKey().sym(), states))) {
+        // The application gets the key, so show the delayed update first.
+        flushUI();
+        return;
+    }
+
+    maybeSyncProgramNameToSession();
+    // Key release rarely changes anything, reuse the mode from the last update
+    // unless it is known to be outdated.
+    if (!updatePending_ && (!event.isRelease() || lastModeOutdated_)) {
+        lastMode_ = subMode();
+        lastModeOutdated_ = false;
+    }
+
+    std::string lastSchema;
+    if (!event.isRelease()) {
+        lastSchema = currentSchema();
+    }
+    const auto notificationSerial = engine_->notificationSerial();
     if (states.test(KeyState::Super)) {
         // IBus uses virtual super mask.
         states |= KeyState::Super2;
@@ -204,6 +421,13 @@ void RimeState::keyEvent(KeyEvent &event) {
         // IBUS_RELEASE_MASK
         intStates |= (1 << 30);
     }
+    if (async) {
+        processKeyAsync(event, intStates, std::move(composeResult),
+                        std::move(lastSchema));
+        return;
+    }
+    bool committed = false;
+    std::optional<uint64_t> processKeyTime;
     if (!composeResult.empty()) {
         event.filterAndAccept();
         auto length = utf8::lengthValidated(composeResult);
@@ -212,83 +436,481 @@ void RimeState::keyEvent(KeyEvent &event) {
             auto c = utf8::getChar(composeResult);
             auto sym = Key::keySymFromUnicode(c);
             if (sym != FcitxKey_None) {
+                RimeStageTimer timer(histograms, RimeStage::ProcessKey,
+                                     budget ? &processKeyTime : nullptr);
+                RimeCallWatch watch(engine_->watchdog(), api, "process_key",
+                                    session, cachedSchema(), sym);
                 result = api->process_key(session, sym, intStates);
             }
         }
         if (!result) {
             commitPreedit(ic);
             ic->commitString(composeResult);
+            invalidateUI();
             clear();
+            committed = true;
+            if (trace) {
+                // Link the key to the commit it produces.
+                trace->flow(composeEnd);
+            }
         }
     } else {
-        auto result =
-            api->process_key(session, event.rawKey().sym(), intStates);
+        bool result = false;
+        {
+            RimeStageTimer timer(histograms, RimeStage::ProcessKey,
+                                 budget ? &processKeyTime : nullptr);
+            RimeCallWatch watch(engine_->watchdog(), api, "process_key",
+                                session, cachedSchema(), event.rawKey().sym());
+            result = api->process_key(session, event.rawKey().sym(), intStates);
+        }
         if (result) {
             event.filterAndAccept();
         }
     }
+    if (processKeyTime) {
+        recordKeyLatency(*processKeyTime);
+    }
 
-    RIME_STRUCT(RimeCommit, commit);
-    if (api->get_commit(session, &commit)) {
-        ic->commitString(commit.text);
-        api->free_commit(&commit);
-        engine_->instance()->resetCompose(ic);
+    {
+        RimeStageTimer timer(histograms, RimeStage::Commit);
+        RIME_STRUCT(RimeCommit, commit);
+        if (api->get_commit(session, &commit)) {
+            RIME_PROBE(commit, session, std::strlen(commit.text));
+            ic->commitString(commit.text);
+            api->free_commit(&commit);
+            engine_->instance()->resetCompose(ic);
+            invalidateUI();
+            committed = true;
+            if (histograms) {
+                engine_->metrics().recordCommit(cachedSchema());
+            }
+            if (trace) {
+                // Link the key to the commit it produces.
+                trace->flow(composeEnd);
+            }
+        }
+    }
+    // The UI update may be delayed, but the next key needs to know whether
+    // it can bypass rime.
+    const char *input = api->get_input(session);
+    composing_ = input && input[0];
+    if (!committed && event.isRelease() && !event.filtered() &&
+        notificationSerial == engine_->notificationSerial()) {
+        // Release is ignored by rime and nothing is notified, so the context
+        // is the same as the one we already have on the panel.
+        return;
+    }
+
+    // Always show the result of a commit right away.
+    requestUIUpdate(event.isRelease(), lastSchema, /*immediate=*/committed);
+}
+
+void RimeState::requestUIUpdate(bool keyRelease, const std::string &lastSchema,
+                                bool immediate) {
+    if (!keyRelease && pendingKeyRelease_) {
+        pendingLastSchema_ = lastSchema;
+    }
+    pendingKeyRelease_ = pendingKeyRelease_ && keyRelease;
+    const bool wasPending = std::exchange(updatePending_, true);
+
+    const auto &config = engine_->config();
+    const uint64_t interval =
+        static_cast<uint64_t>(*config.uiUpdateInterval) * 1000;
+    const auto current = now(CLOCK_MONOTONIC);
+    const auto deadline = lastUIUpdateTime_ + interval;
+    if (immediate ||
+        (!*config.coalesceKeyEvents && (!interval || current >= deadline))) {
+        flushUI();
+        return;
+    }
+    if (wasPending) {
+        return;
+    }
+
+    if (current < deadline) {
+        if (uiUpdateTimer_) {
+            uiUpdateTimer_->setTime(deadline);
+        } else {
+            uiUpdateTimer_ = engine_->instance()->eventLoop().addTimeEvent(
+                CLOCK_MONOTONIC, deadline, 0,
+                [this](EventSourceTime * /*unused*/,
+                       uint64_t /*unused*/) {
+                    flushUI();
+                    return true;
+                });
+        }
+        uiUpdateTimer_->setOneShot();
+        return;
+    }
+
+    // Let the event loop deliver the rest of the burst first.
+    engine_->eventDispatcher().schedule(
+        [engine = engine_, ref = ic_.watch()]() {
+            auto *ic = ref.get();
+            if (!ic) {
+                return;
+            }
+            if (auto *state = engine->state(ic)) {
+                state->flushUI();
+            }
+        });
+}
+
+void RimeState::processKeyAsync(KeyEvent &event, uint32_t states,
+                                std::string composeResult,
+                                std::string lastSchema) {
+    // Rime is asked later, so take the key now and forward it back to the
+    // application if rime doesn't handle it.
+    event.filterAndAccept();
+    auto sym = event.rawKey().sym();
+    if (!composeResult.empty()) {
+        sym = FcitxKey_None;
+        if (utf8::lengthValidated(composeResult) == 1) {
+            sym = Key::keySymFromUnicode(utf8::getChar(composeResult));
+        }
+    }
+
+    inFlight_ += 1;
+    auto *api = engine_->api();
+    const bool budget = engine_->latencyBudget().enabled();
+    engine_->worker().post(
+        [this, alive = std::weak_ptr<bool>(alive_), api, budget,
+         &watchdog = engine_->watchdog(), session = session_->id(), sym,
+         states, key = event.rawKey(),
+         keyRelease = event.isRelease(),
+         composeResult = std::move(composeResult),
+         lastSchema = std::move(lastSchema)]() -> std::function<void()> {
+            // This part runs on the worker thread.
+            auto result = std::make_shared<RimeKeyResult>();
+            if (!api->find_session(session)) {
+                return [this, alive, result]() {
+                    if (!alive.expired()) {
+                        inFlight_ -= 1;
+                    }
+                };
+            }
+            RimeKeyResultScope scope(result.get(), session);
+            if (sym != FcitxKey_None) {
+                const auto start = budget ? RimeMetrics::timestamp() : 0;
+                RimeCallWatch watch(watchdog, api, "process_key", session,
+                                    lastSchema, sym);
+                result->accepted = api->process_key(session, sym, states);
+                if (budget) {
+                    result->processKeyTime = RimeMetrics::timestamp() - start;
+                }
+            }
+            if (!result->accepted && !composeResult.empty()) {
+                // Same as commitPreedit and clear.
+                RIME_STRUCT(RimeContext, context);
+                if (api->get_context(session, &context)) {
+                    if (context.composition.length > 0 &&
+                        context.commit_text_preview) {
+                        result->commitPreview = context.commit_text_preview;
+                    }
+                    api->free_context(&context);
+                }
+                api->clear_composition(session);
+            }
+            collectResult(api, session, *result);
+            return [this, alive, result, key, keyRelease, composeResult,
+                    lastSchema]() {
+                if (!alive.expired()) {
+                    applyKeyResult(*result, key, keyRelease, composeResult,
+                                   lastSchema);
+                }
+            };
+        });
+}
+
+void RimeState::applyKeyResult(const RimeKeyResult &result, const Key &key,
+                               bool keyRelease,
+                               const std::string &composeResult,
+                               const std::string &lastSchema) {
+    inFlight_ -= 1;
+    bool committed = false;
+    if (!result.accepted && !composeResult.empty()) {
+        if (!result.commitPreview.empty()) {
+            ic_.commitString(result.commitPreview);
+        }
+        ic_.commitString(composeResult);
+        committed = true;
+    }
+    if (result.commit) {
+        RIME_PROBE(commit, session_ ? session_->id() : 0,
+                   result.commit->size());
+        ic_.commitString(*result.commit);
+        engine_->instance()->resetCompose(&ic_);
+        committed = true;
+    }
+    if (!result.accepted && composeResult.empty()) {
+        ic_.forwardKey(key, keyRelease);
+    }
+    if (committed) {
+        invalidateUI();
+    }
+
+    applySnapshots(result);
+    if (result.processKeyTime) {
+        recordKeyLatency(*result.processKeyTime);
+    }
+    requestUIUpdate(keyRelease, lastSchema, /*immediate=*/committed);
+}
+
+void RimeState::postAction(
+    const char *call,
+    std::function<void(rime_api_t *, RimeSessionId)> action) {
+    inFlight_ += 1;
+    engine_->worker().post([this, alive = std::weak_ptr<bool>(alive_),
+                            api = engine_->api(),
+                            &watchdog = engine_->watchdog(),
+                            session = session_->id(), call,
+                            schema = engine_->watchdog().threshold()
+                                         ? cachedSchema()
+                                         : std::string(),
+                            action = std::move(action)]()
+                               -> std::function<void()> {
+        // This part runs on the worker thread.
+        auto result = std::make_shared<RimeKeyResult>();
+        if (api->find_session(session)) {
+            RimeKeyResultScope scope(result.get(), session);
+            {
+                RimeCallWatch watch(watchdog, api, call, session, schema);
+                action(api, session);
+            }
+            collectResult(api, session, *result);
+        }
+        return [this, alive, result]() {
+            if (alive.expired()) {
+                return;
+            }
+            inFlight_ -= 1;
+            if (result->commit) {
+                ic_.commitString(*result->commit);
+                invalidateUI();
+            }
+            applySnapshots(*result);
+            requestUIUpdate(/*keyRelease=*/false, {}, /*immediate=*/true);
+        };
+    });
+}
+
+void RimeState::applySnapshots(const RimeKeyResult &result) {
+    contextSnapshot_ = result.context;
+    statusSnapshot_ = result.status;
+    if (contextSnapshot_) {
+        const auto &context = contextSnapshot_->context();
+        composing_ = context.composition.length > 0 ||
+                     context.menu.num_candidates > 0;
+    }
+    statusSnapshotSerial_ = engine_->notificationSerial();
+    if (statusSnapshot_) {
+        const auto *schema = statusSnapshot_->status().schema_id;
+        cachedSchema_ = schema ? schema : "";
+        cachedSchemaSerial_ = engine_->notificationSerial();
+    }
+    for (const auto &option : result.changedOptions) {
+        addChangedOption(option);
+    }
+}
+
+void RimeState::recordKeyLatency(uint64_t latency) {
+    const auto &schema = cachedSchema();
+    if (!engine_->latencyBudget().record(schema, latency)) {
+        return;
+    }
+    if (engine_->latencyBudget().degraded(schema)) {
+        RIME_WARN() << "Schema " << schema
+                    << " exceeds latency budget, simplify input panel.";
+    } else {
+        RIME_WARN() << "Schema " << schema << " is within latency budget.";
+    }
+    invalidateUI();
+}
+
+bool RimeState::degraded() {
+    return engine_->latencyBudget().enabled() &&
+           engine_->latencyBudget().degraded(cachedSchema());
+}
+
+void RimeState::flushUI() {
+    if (!updatePending_) {
+        return;
+    }
+    const bool keyRelease = pendingKeyRelease_;
+    const auto lastSchema = std::move(pendingLastSchema_);
+    pendingKeyRelease_ = true;
+    pendingLastSchema_.clear();
+    auto *trace = RimeTraceRecorder::current();
+    const auto start = trace ? RimeMetrics::timestamp() : 0;
+    updateUI(&ic_, keyRelease);
+    maybeShowChangedOptions(keyRelease, lastSchema);
+    if (trace) {
+        trace->slice("flush_ui", start, RimeMetrics::timestamp() - start);
     }
+}
 
-    updateUI(ic, event.isRelease());
-    if (!event.isRelease() && !lastSchema.empty() &&
-        lastSchema == currentSchema() && ic->inputPanel().empty() &&
-        !changedOptions_.empty()) {
+void RimeState::maybeShowChangedOptions(bool keyRelease,
+                                        const std::string &lastSchema) {
+    if (!keyRelease && !lastSchema.empty() && lastSchema == currentSchema() &&
+        ic_.inputPanel().empty() && !changedOptions_.empty()) {
         showChangedOptions();
     }
 }
 
+bool RimeState::panelOutdated() {
+    if (!updatePending_ && !inFlight_) {
+        return false;
+    }
+    // Index from the panel may point to another candidate now, show what rime
+    // has instead.
+    flushUI();
+    return true;
+}
+
 void RimeState::selectCandidate(InputContext *inputContext, int idx,
                                 bool global) {
     auto *api = engine_->api();
-    if (api->is_maintenance_mode()) {
+    if (api->is_maintenance_mode() || panelOutdated()) {
         return;
     }
-    auto session = this->session();
+    if (engine_->worker().running() && this->session()) {
+        postAction("select_candidate", [idx, global](rime_api_t *api,
+                                                     RimeSessionId session) {
+            if (global) {
+                api->select_candidate(session, idx);
+            } else {
+                api->select_candidate_on_current_page(session, idx);
+            }
+        });
+        return;
+    }
+    auto session = this->syncSession();
     if (!session) {
         return;
     }
-    if (global) {
-        api->select_candidate(session, idx);
-    } else {
-        api->select_candidate_on_current_page(session, idx);
+    {
+        RimeCallWatch watch(engine_->watchdog(), api, "select_candidate",
+                            session, cachedSchema());
+        if (global) {
+            api->select_candidate(session, idx);
+        } else {
+            api->select_candidate_on_current_page(session, idx);
+        }
     }
     RIME_STRUCT(RimeCommit, commit);
     if (api->get_commit(session, &commit)) {
+        RIME_PROBE(commit, session, std::strlen(commit.text));
         inputContext->commitString(commit.text);
         api->free_commit(&commit);
+        invalidateUI();
     }
     updateUI(inputContext, false);
 }
 
+void RimeState::changePage(bool backward) {
+    auto *api = engine_->api();
+    if (api->is_maintenance_mode()) {
+        return;
+    }
+#ifndef FCITX_RIME_NO_CHANGE_PAGE
+    if (RIME_API_AVAILABLE(api, change_page)) {
+        if (engine_->worker().running() && this->session()) {
+            postAction("change_page",
+                       [backward](rime_api_t *api, RimeSessionId session) {
+                           api->change_page(session, backward);
+                       });
+            return;
+        }
+        auto session = this->syncSession();
+        if (!session) {
+            return;
+        }
+        {
+            RimeCallWatch watch(engine_->watchdog(), api, "change_page",
+                                session, cachedSchema());
+            api->change_page(session, backward);
+        }
+        // Preedit is unchanged, and won't be sent again.
+        updateUI(&ic_, false);
+        return;
+    }
+#endif
+    KeyEvent event(&ic_, Key(backward ? FcitxKey_Page_Up : FcitxKey_Page_Down));
+    keyEvent(event);
+}
+
 #ifndef FCITX_RIME_NO_DELETE_CANDIDATE
 void RimeState::deleteCandidate(int idx, bool global) {
     auto *api = engine_->api();
-    if (api->is_maintenance_mode()) {
+    if (api->is_maintenance_mode() || panelOutdated()) {
         return;
     }
-    auto session = this->session();
+    if (engine_->worker().running() && this->session()) {
+        postAction("delete_candidate", [idx, global](rime_api_t *api,
+                                                     RimeSessionId session) {
+            if (global) {
+                api->delete_candidate(session, idx);
+            } else {
+                api->delete_candidate_on_current_page(session, idx);
+            }
+        });
+        return;
+    }
+    auto session = this->syncSession();
     if (!session) {
         return;
     }
-    if (global) {
-        api->delete_candidate(session, idx);
-    } else {
-        api->delete_candidate_on_current_page(session, idx);
+    {
+        RimeCallWatch watch(engine_->watchdog(), api, "delete_candidate",
+                            session, cachedSchema());
+        if (global) {
+            api->delete_candidate(session, idx);
+        } else {
+            api->delete_candidate_on_current_page(session, idx);
+        }
     }
     updateUI(&ic_, false);
 }
 #endif
 
+#ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
+void RimeState::highlightCandidate(int idx) {
+    auto *api = engine_->api();
+    if (api->is_maintenance_mode() || panelOutdated()) {
+        return;
+    }
+    if (engine_->worker().running() && this->session()) {
+        postAction("highlight_candidate",
+                   [idx](rime_api_t *api, RimeSessionId session) {
+                       api->highlight_candidate(session, idx);
+                   });
+        return;
+    }
+    auto session = this->syncSession();
+    if (!session) {
+        return;
+    }
+    RimeCallWatch watch(engine_->watchdog(), api, "highlight_candidate",
+                        session, cachedSchema());
+    api->highlight_candidate(session, idx);
+}
+#endif
+
 bool RimeState::getStatus(
     const std::function<void(const RimeStatus &)> &callback) {
+    // Status may be changed by a notification, e.g. from another input
+    // context that shares the session. While the worker is busy, the keys in
+    // flight bring a newer one soon, so don't wait for it.
+    if (statusSnapshot_ && engine_->worker().running() &&
+        (statusSnapshotSerial_ == engine_->notificationSerial() ||
+         !engine_->worker().idle())) {
+        // Callback may call into librime and drop the snapshot.
+        auto snapshot = statusSnapshot_;
+        callback(snapshot->status());
+        return true;
+    }
     auto *api = engine_->api();
-    auto session = this->session();
+    auto session = this->syncSession();
     if (!session) {
         return false;
     }
@@ -296,11 +918,93 @@ bool RimeState::getStatus(
     if (!api->get_status(session, &status)) {
         return false;
     }
+    if (engine_->worker().running()) {
+        // Keep it, so the next one doesn't need to wait for the worker.
+        statusSnapshot_ = std::make_shared<RimeStatusSnapshot>(status);
+        statusSnapshotSerial_ = engine_->notificationSerial();
+        api->free_status(&status);
+        auto snapshot = statusSnapshot_;
+        callback(snapshot->status());
+        return true;
+    }
     callback(status);
     api->free_status(&status);
     return true;
 }
 
+bool RimeState::peekStatus(
+    const std::function<void(const RimeStatus &)> &callback) {
+    if (engine_->worker().idle()) {
+        return getStatus(callback);
+    }
+    if (!statusSnapshot_) {
+        return false;
+    }
+    auto snapshot = statusSnapshot_;
+    callback(snapshot->status());
+    return true;
+}
+
+bool RimeLabelCache::matches(const RimeContext &context) const {
+    const auto &menu = context.menu;
+    if (!labels_ ||
+        labels_->size() < static_cast<size_t>(menu.num_candidates) ||
+        selectKeys_ != (menu.select_keys ? menu.select_keys : "")) {
+        return false;
+    }
+    const bool hasLabel =
+        RIME_STRUCT_HAS_MEMBER(context, context.select_labels) &&
+        context.select_labels;
+    if (!hasLabel) {
+        return selectLabels_.empty();
+    }
+    if (selectLabels_.size() != static_cast<size_t>(menu.page_size)) {
+        return false;
+    }
+    for (int i = 0; i < menu.page_size; i++) {
+        if (selectLabels_[i] != context.select_labels[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const std::vector<Text>>
+RimeLabelCache::labels(const RimeContext &context) {
+    if (matches(context)) {
+        return labels_;
+    }
+    const auto &menu = context.menu;
+    selectKeys_ = menu.select_keys ? menu.select_keys : "";
+    selectLabels_.clear();
+    const bool hasLabel =
+        RIME_STRUCT_HAS_MEMBER(context, context.select_labels) &&
+        context.select_labels;
+    if (hasLabel) {
+        for (int i = 0; i < menu.page_size; i++) {
+            selectLabels_.emplace_back(context.select_labels[i]);
+        }
+    }
+
+    const int size = std::max(menu.num_candidates, menu.page_size);
+    auto labels = std::make_shared<std::vector<Text>>();
+    labels->reserve(size);
+    for (int i = 0; i < size; ++i) {
+        std::string label;
+        if (i < menu.page_size && hasLabel) {
+            label = context.select_labels[i];
+        } else if (i < static_cast<int>(selectKeys_.size())) {
+            label = std::string(1, selectKeys_[i]);
+        } else {
+            label = std::to_string((i + 1) % 10);
+        }
+        label.append(" ");
+        labels->emplace_back(std::move(label));
+    }
+    labels_ = std::move(labels);
+    return labels_;
+}
+
 Text preeditFromRimeContext(const RimeContext &context, TextFormatFlags flag,
                             TextFormatFlags highlightFlag) {
     Text preedit;
@@ -352,6 +1056,10 @@ void RimeState::updatePreedit(InputContext *ic, const RimeContext &context) {
     PreeditMode mode = ic->capabilityFlags().test(CapabilityFlag::Preedit)
                            ? *engine_->config().preeditMode
                            : PreeditMode::No;
+    // Keep the preedit in application simple while rime is slow.
+    if (mode != PreeditMode::No && degraded()) {
+        mode = PreeditMode::CommitPreview;
+    }
 
     switch (mode) {
     case PreeditMode::No:
@@ -392,54 +1100,180 @@ void RimeState::updatePreedit(InputContext *ic, const RimeContext &context) {
 }
 
 void RimeState::updateUI(InputContext *ic, bool keyRelease) {
+    updatePending_ = false;
+    if (uiUpdateTimer_) {
+        uiUpdateTimer_->setEnabled(false);
+    }
+    lastUIUpdateTime_ = now(CLOCK_MONOTONIC);
     auto &inputPanel = ic->inputPanel();
+    // Somebody else touched the panel since our last update, e.g. input method
+    // information or reset, so whatever we have now needs to be sent again.
+    if (lastPreeditFingerprint_ &&
+        *lastPreeditFingerprint_ != preeditFingerprint(inputPanel)) {
+        lastPreeditFingerprint_.reset();
+    }
+    if (lastPanelFingerprint_ &&
+        *lastPanelFingerprint_ != panelFingerprint(inputPanel)) {
+        lastPanelFingerprint_.reset();
+    }
     if (!keyRelease) {
         inputPanel.reset();
     }
 
+    // The session isn't synced when the context comes from the worker.
+    [[maybe_unused]] const RimeSessionId probeSession =
+        session_ ? session_->id() : 0;
+    RimeStageHistograms *histograms = nullptr;
     do {
         auto *api = engine_->api();
         if (api->is_maintenance_mode()) {
             return;
         }
-        auto session = this->session();
-        if (!api->find_session(session)) {
-            return;
+        // Librime may be busy with the next key, use the context from the
+        // worker instead.
+        std::shared_ptr<RimeContextSnapshot> snapshot;
+        if (engine_->worker().running()) {
+            snapshot = contextSnapshot_;
         }
-
-        RIME_STRUCT(RimeContext, context);
-        if (!api->get_context(session, &context)) {
-            break;
+        RimeSessionId session = 0;
+        if (!snapshot) {
+            session = this->syncSession();
+            RIME_PROBE(api_entry, session, "find_session");
+            const bool found = api->find_session(session);
+            RIME_PROBE(api_return, session, "find_session");
+            if (!found) {
+                return;
+            }
         }
+        histograms = stageHistograms();
+
+        RIME_STRUCT(RimeContext, rimeContext);
+        const RimeContext &context =
+            snapshot ? snapshot->context() : rimeContext;
+        composing_ = true;
+        if (!snapshot) {
+            RimeStageTimer timer(histograms, RimeStage::GetContext);
+            RimeCallWatch watch(engine_->watchdog(), api, "get_context",
+                                session, cachedSchema());
+            RIME_PROBE(api_entry, session, "get_context");
+            const bool hasContext = api->get_context(session, &rimeContext);
+            RIME_PROBE(api_return, session, "get_context");
+            if (!hasContext) {
+                break;
+            }
+        }
+        composing_ = context.composition.length > 0 ||
+                     context.menu.num_candidates > 0;
 
-        updatePreedit(ic, context);
+        RIME_PROBE(panel_start, probeSession);
+        {
+            RimeStageTimer timer(histograms, RimeStage::Preedit);
+            updatePreedit(ic, context);
+        }
 
-        if (context.menu.num_candidates) {
-            ic->inputPanel().setCandidateList(
-                std::make_unique<RimeCandidateList>(engine_, ic, context));
-        } else {
-            ic->inputPanel().setCandidateList(nullptr);
+        {
+            RimeStageTimer timer(histograms, RimeStage::CandidateList);
+            if (context.menu.num_candidates) {
+                // Don't let UI fetch more candidates if rime is slow.
+                ic->inputPanel().setCandidateList(
+                    std::make_unique<RimeCandidateList>(
+                        engine_, ic, context, labelCache_.labels(context),
+                        !degraded()));
+                engine_->metrics().recordCandidateList(
+                    context.menu.num_candidates);
+            } else {
+                ic->inputPanel().setCandidateList(nullptr);
+            }
         }
+        RIME_PROBE(panel_end, probeSession, context.menu.num_candidates);
 
-        api->free_context(&context);
+        if (!snapshot) {
+            RIME_PROBE(api_entry, session, "free_context");
+            api->free_context(&rimeContext);
+            RIME_PROBE(api_return, session, "free_context");
+        }
     } while (false);
 
-    ic->updatePreedit();
-    if (lastMode_ != subMode()) {
+    // Time spent on sending the preedit and panel to frontend, only recorded
+    // if any of them is sent.
+    uint64_t userInterfaceTime = 0;
+    bool userInterfaceUpdated = false;
+    auto &counters = engine_->updateCounters();
+    RIME_PROBE(ui_start, probeSession);
+    auto preedit = preeditFingerprint(inputPanel);
+    auto *trace = RimeTraceRecorder::current();
+    const bool measure = histograms || trace;
+    if (lastPreeditFingerprint_ != preedit) {
+        const auto start = measure ? RimeMetrics::timestamp() : 0;
+        ic->updatePreedit();
+        if (measure) {
+            const auto duration = RimeMetrics::timestamp() - start;
+            userInterfaceTime += duration;
+            if (trace) {
+                trace->slice("update_preedit", start, duration);
+            }
+        }
+        lastPreeditFingerprint_ = preedit;
+        userInterfaceUpdated = true;
+        counters.preeditSent += 1;
+    } else {
+        counters.preeditSkipped += 1;
+    }
+
+    auto mode = subMode();
+    if (lastMode_ != mode) {
         engine_->instance()->showInputMethodInformation(ic);
         ic->updateUserInterface(UserInterfaceComponent::StatusArea);
     }
+    lastMode_ = std::move(mode);
+    lastModeOutdated_ = false;
 
     if (!keyRelease) {
-        ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+        auto panel = panelFingerprint(inputPanel);
+        if (lastPanelFingerprint_ != panel) {
+            const auto start = measure ? RimeMetrics::timestamp() : 0;
+            ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+            if (measure) {
+                const auto duration = RimeMetrics::timestamp() - start;
+                userInterfaceTime += duration;
+                if (trace) {
+                    trace->slice("update_input_panel", start, duration);
+                }
+            }
+            lastPanelFingerprint_ = panel;
+            userInterfaceUpdated = true;
+            counters.panelSent += 1;
+        } else {
+            counters.panelSkipped += 1;
+        }
     }
+    if (userInterfaceUpdated) {
+        recordStage(histograms, RimeStage::UpdateUserInterface,
+                    userInterfaceTime);
+    }
+    RIME_PROBE(ui_end, probeSession, userInterfaceUpdated);
+}
+
+RimeStageHistograms *RimeState::stageHistograms() {
+    if (!engine_->metrics().enabled()) {
+        return nullptr;
+    }
+    return engine_->metrics().histograms(cachedSchema());
 }
 
-void RimeState::release() { session_.reset(); }
+void RimeState::invalidateUI() {
+    lastPreeditFingerprint_.reset();
+    lastPanelFingerprint_.reset();
+}
+
+void RimeState::release() {
+    session_.reset();
+    cachedSchemaSerial_.reset();
+}
 
 void RimeState::commitInput(InputContext *ic) {
     if (auto *api = engine_->api()) {
-        if (const char *input = api->get_input(this->session())) {
+        if (const char *input = api->get_input(this->syncSession())) {
             if (std::strlen(input) > 0) {
                 ic->commitString(input);
             }
@@ -450,7 +1284,7 @@ void RimeState::commitInput(InputContext *ic) {
 void RimeState::commitComposing(InputContext *ic) {
     if (auto *api = engine_->api()) {
         RIME_STRUCT(RimeContext, context);
-        auto session = this->session();
+        auto session = this->syncSession();
         if (!api->get_context(session, &context)) {
             return;
         }
@@ -464,7 +1298,7 @@ void RimeState::commitComposing(InputContext *ic) {
 void RimeState::commitPreedit(InputContext *ic) {
     if (auto *api = engine_->api()) {
         RIME_STRUCT(RimeContext, context);
-        auto session = this->session();
+        auto session = this->syncSession();
         if (!api->get_context(session, &context)) {
             return;
         }
@@ -522,9 +1356,10 @@ void RimeState::restore() {
     selectSchema(savedCurrentSchema_);
     for (const auto &option : savedOptions_) {
         if (option.starts_with("!")) {
-            engine_->api()->set_option(session(), option.c_str() + 1, false);
+            engine_->api()->set_option(syncSession(), option.c_str() + 1,
+                                       false);
         } else {
-            engine_->api()->set_option(session(), option.c_str(), true);
+            engine_->api()->set_option(syncSession(), option.c_str(), true);
         }
     }
 }
@@ -537,7 +1372,7 @@ void RimeState::maybeSyncProgramNameToSession() {
         return;
     }
 
-    if (session_) {
+    if (session_ && session_->programName() != ic_.program()) {
         session_->setProgramName(ic_.program());
     }
 }
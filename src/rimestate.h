@@ -6,17 +6,25 @@
 #ifndef _FCITX_RIMESTATE_H_
 #define _FCITX_RIMESTATE_H_
 
+#include "rimemetrics.h"
 #include "rimesession.h"
+#include "rimeworker.h"
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-utils/eventloopinterface.h>
 #include <fcitx-utils/key.h>
 #include <fcitx/event.h>
 #include <fcitx/globalconfig.h>
 #include <fcitx/inputcontextmanager.h>
 #include <fcitx/inputcontextproperty.h>
+#include <fcitx/text.h>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <rime_api.h>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #define RIME_ASCII_MODE "ascii_mode"
@@ -25,6 +33,21 @@ namespace fcitx::rime {
 
 class RimeEngine;
 
+// Candidate labels, only rebuilt when the select keys or labels change, e.g.
+// on switching schema. The result is immutable and shared by candidate lists.
+class RimeLabelCache {
+public:
+    std::shared_ptr<const std::vector<Text>>
+    labels(const RimeContext &context);
+
+private:
+    bool matches(const RimeContext &context) const;
+
+    std::string selectKeys_;
+    std::vector<std::string> selectLabels_;
+    std::shared_ptr<const std::vector<Text>> labels_;
+};
+
 class RimeState : public InputContextProperty {
 public:
     RimeState(RimeEngine *engine, InputContext &ic);
@@ -38,9 +61,20 @@ public:
 #ifndef FCITX_RIME_NO_DELETE_CANDIDATE
     void deleteCandidate(int idx, bool global);
 #endif
+#ifndef FCITX_RIME_NO_HIGHLIGHT_CANDIDATE
+    void highlightCandidate(int idx);
+#endif
+    // Page the candidates without going through key handling when librime
+    // supports it.
+    void changePage(bool backward);
     bool getStatus(const std::function<void(const RimeStatus &)> &);
+    // Same as getStatus, but use the last snapshot instead of waiting for a
+    // busy worker.
+    bool peekStatus(const std::function<void(const RimeStatus &)> &);
     void updatePreedit(InputContext *ic, const RimeContext &context);
     void updateUI(InputContext *ic, bool keyRelease);
+    // Run the delayed UI update, if there is any.
+    void flushUI();
     void release();
     void commitInput(InputContext *ic);
     void commitComposing(InputContext *ic);
@@ -50,27 +84,95 @@ public:
     void toggleLatinMode();
     void setLatinMode(bool latin);
     void selectSchema(const std::string &schemaId);
+    // Only waits for the worker if a session needs to be created, use
+    // syncSession to call librime from the main thread.
     RimeSessionId session(bool requestNewSession = true);
+    // Wait for the worker, so librime can be called from the main thread.
+    // Snapshots are dropped since the call may change the session.
+    RimeSessionId syncSession(bool requestNewSession = true);
 
     void snapshot();
     void restore();
     std::string currentSchema();
+    // Same as currentSchema, but only query rime after a notification.
+    const std::string &cachedSchema();
+    // Latency histograms of current schema, nullptr if metrics is disabled.
+    RimeStageHistograms *stageHistograms();
     void addChangedOption(std::string_view option);
     void showChangedOptions();
+    // Forget what was sent to the panel, so the next update is always sent.
+    void invalidateUI();
 
 private:
     std::string asciiModeName(bool abbrev);
     void maybeSyncProgramNameToSession();
     std::vector<std::string> snapshotOptions(const std::string &schema);
+    void requestUIUpdate(bool keyRelease, const std::string &lastSchema,
+                         bool immediate);
+    void maybeShowChangedOptions(bool keyRelease,
+                                 const std::string &lastSchema);
+    // Whether the panel on screen is behind rime, because its update is
+    // delayed or keys are still in flight. The delayed update is flushed.
+    bool panelOutdated();
+    void recordKeyLatency(uint64_t latency);
+    // Whether the schema is too slow and the input panel should be simple.
+    bool degraded();
+    // Process the key on the worker thread, and apply the result later.
+    void processKeyAsync(KeyEvent &event, uint32_t states,
+                         std::string composeResult, std::string lastSchema);
+    void applyKeyResult(const RimeKeyResult &result, const Key &key,
+                        bool keyRelease, const std::string &composeResult,
+                        const std::string &lastSchema);
+    // Run a call that changes the session on the worker after the keys in
+    // flight, and update the UI with its result. call names it in the
+    // watchdog.
+    void postAction(const char *call,
+                    std::function<void(rime_api_t *, RimeSessionId)> action);
+    void applySnapshots(const RimeKeyResult &result);
+    void dropSnapshots();
 
     std::string lastMode_;
+    bool lastModeOutdated_ = true;
+    // Whether there is anything composed after the last key, or when the UI
+    // is last updated.
+    bool composing_ = true;
+    std::string cachedSchema_;
+    std::optional<uint64_t> cachedSchemaSerial_;
+    // Latin mode labels from schema, as {full, abbreviated}.
+    std::optional<std::pair<std::string, std::string>> asciiModeLabels_;
+    std::optional<uint64_t> asciiModeLabelsSerial_;
+
+    // UI update delayed to the end of a burst of key events, or the next
+    // frame.
+    bool updatePending_ = false;
+    bool pendingKeyRelease_ = true;
+    std::string pendingLastSchema_;
+    uint64_t lastUIUpdateTime_ = 0;
+    std::unique_ptr<EventSourceTime> uiUpdateTimer_;
     RimeEngine *engine_;
     InputContext &ic_;
     std::shared_ptr<RimeSessionHolder> session_;
 
+    // Result of the last key processed by the worker, or the last status
+    // read from the main thread, only valid until librime is called from the
+    // main thread again.
+    std::shared_ptr<RimeContextSnapshot> contextSnapshot_;
+    std::shared_ptr<RimeStatusSnapshot> statusSnapshot_;
+    std::optional<uint64_t> statusSnapshotSerial_;
+    // Keys posted to the worker but not applied yet.
+    size_t inFlight_ = 0;
+    // Expires with the state, checked by callbacks from the worker.
+    std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+
     std::string savedCurrentSchema_;
     std::vector<std::string> savedOptions_;
     std::vector<std::string> changedOptions_;
+
+    RimeLabelCache labelCache_;
+
+    // Fingerprint of the client preedit / input panel that is last sent.
+    std::optional<uint64_t> lastPreeditFingerprint_;
+    std::optional<uint64_t> lastPanelFingerprint_;
 };
 } // namespace fcitx::rime
 
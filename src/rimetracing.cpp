@@ -0,0 +1,202 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimetracing.h"
+#include "rimemetrics.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fcitx::rime {
+
+namespace {
+
+constexpr const char flowName[] = "key_to_commit";
+
+void appendTimestamp(std::string &out, uint64_t nanoseconds) {
+    // Chrome trace uses microseconds.
+    out += std::to_string(nanoseconds / 1000);
+    const auto fraction = std::to_string(nanoseconds % 1000 + 1000);
+    out += '.';
+    out += fraction.substr(1);
+}
+
+void appendEvent(std::string &out, const RimeTraceEvent &event,
+                 const std::string &pid) {
+    out += "{\"ph\":\"";
+    out += event.phase;
+    out += "\",\"name\":\"";
+    out += event.name;
+    out += "\",\"pid\":";
+    out += pid;
+    out += ",\"tid\":";
+    out += pid;
+    out += ",\"ts\":";
+    appendTimestamp(out, event.timestamp);
+    switch (event.phase) {
+    case 'X':
+        out += ",\"dur\":";
+        appendTimestamp(out, event.duration);
+        if (event.argName) {
+            out += ",\"args\":{\"";
+            out += event.argName;
+            out += "\":";
+            out += std::to_string(event.argValue);
+            out += "}";
+        }
+        break;
+    case 'C':
+        out += ",\"args\":{\"value\":";
+        out += std::to_string(event.id);
+        out += "}";
+        break;
+    case 's':
+    case 'f':
+        out += ",\"cat\":\"rime\",\"id\":";
+        out += std::to_string(event.id);
+        if (event.phase == 'f') {
+            // Bind to the enclosing slice.
+            out += ",\"bp\":\"e\"";
+        }
+        break;
+    default:
+        break;
+    }
+    out += "},\n";
+}
+
+} // namespace
+
+RimeTraceRecorder *RimeTraceRecorder::current_ = nullptr;
+
+RimeTraceRecorder::RimeTraceRecorder() : ring_(Capacity) {}
+
+RimeTraceRecorder::~RimeTraceRecorder() { stop(); }
+
+bool RimeTraceRecorder::start(const std::filesystem::path &path) {
+    if (thread_.joinable()) {
+        return false;
+    }
+    // Trace has the keys typed by user, keep it private.
+    const int fd =
+        open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    auto *file = fchmod(fd, 0600) == 0 ? fdopen(fd, "w") : nullptr;
+    if (!file) {
+        close(fd);
+        return false;
+    }
+    path_ = path;
+    head_ = 0;
+    size_ = 0;
+    dropped_ = 0;
+    stopping_ = false;
+    thread_ = std::thread(&RimeTraceRecorder::run, this, file);
+    current_ = this;
+    return true;
+}
+
+void RimeTraceRecorder::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    if (current_ == this) {
+        current_ = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+}
+
+void RimeTraceRecorder::slice(const char *name, uint64_t start,
+                              uint64_t duration, const char *argName,
+                              uint64_t argValue) {
+    push({'X', name, start, duration, 0, argName, argValue});
+}
+
+void RimeTraceRecorder::counter(const char *name, uint64_t value) {
+    push({'C', name, RimeMetrics::timestamp(), 0, value, nullptr, 0});
+}
+
+void RimeTraceRecorder::flow(uint64_t start) {
+    const auto id = nextFlowId_++;
+    push({'s', flowName, start, 0, id, nullptr, 0});
+    push({'f', flowName, RimeMetrics::timestamp(), 0, id, nullptr, 0});
+}
+
+void RimeTraceRecorder::push(const RimeTraceEvent &event) {
+    bool wakeUp = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (size_ == Capacity) {
+            dropped_ += 1;
+            return;
+        }
+        ring_[(head_ + size_) % Capacity] = event;
+        size_ += 1;
+        wakeUp = size_ == Capacity / 2;
+    }
+    if (wakeUp) {
+        condition_.notify_one();
+    }
+}
+
+void RimeTraceRecorder::run(std::FILE *file) {
+    const auto pid = std::to_string(getpid());
+    std::vector<RimeTraceEvent> events;
+    events.reserve(Capacity);
+    std::string out = "[\n";
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+            return stopping_ || size_ >= Capacity / 2;
+        });
+        events.clear();
+        for (; size_; size_--) {
+            events.push_back(ring_[head_]);
+            head_ = (head_ + 1) % Capacity;
+        }
+        const bool stopping = stopping_;
+        const auto dropped = dropped_;
+        lock.unlock();
+
+        for (const auto &event : events) {
+            appendEvent(out, event, pid);
+        }
+        if (stopping) {
+            appendEvent(out,
+                        {'C', "dropped_events", RimeMetrics::timestamp(), 0,
+                         dropped, nullptr, 0},
+                        pid);
+            // Remove the trailing comma to make it a valid JSON array.
+            out.resize(out.size() - 2);
+            out += "\n]\n";
+        }
+        std::fwrite(out.data(), 1, out.size(), file);
+        out.clear();
+        if (stopping) {
+            std::fclose(file);
+            return;
+        }
+        lock.lock();
+    }
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMETRACING_H_
+#define _FCITX_RIMETRACING_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fcitx::rime {
+
+struct RimeTraceEvent {
+    // Phase of Chrome trace event format, X for slice, C for counter, s and
+    // f for the two ends of a flow.
+    char phase;
+    // Must be a string literal, since it is only formatted later.
+    const char *name;
+    // Timestamp and duration in nanoseconds.
+    uint64_t timestamp;
+    uint64_t duration;
+    // Flow id for s and f, value for C.
+    uint64_t id;
+    // Optional argument of a slice.
+    const char *argName;
+    uint64_t argValue;
+};
+
+// Record events into a ring buffer, and write them as Chrome trace event
+// JSON from a background thread, which can be loaded by Perfetto UI or
+// chrome://tracing.
+class RimeTraceRecorder {
+public:
+    static constexpr size_t Capacity = 1 << 16;
+
+    RimeTraceRecorder();
+    ~RimeTraceRecorder();
+
+    // The recorder that is currently recording, null if tracing is off. Only
+    // used from the main thread.
+    static RimeTraceRecorder *current() { return current_; }
+
+    bool start(const std::filesystem::path &path);
+    void stop();
+    bool recording() const { return current_ == this; }
+    const std::filesystem::path &path() const { return path_; }
+
+    void slice(const char *name, uint64_t start, uint64_t duration,
+               const char *argName = nullptr, uint64_t argValue = 0);
+    void counter(const char *name, uint64_t value);
+    // Flow from a key at start to the commit it produced now. Both ends are
+    // written together, so keys without commit leave nothing behind.
+    void flow(uint64_t start);
+
+private:
+    void push(const RimeTraceEvent &event);
+    void run(std::FILE *file);
+
+    static RimeTraceRecorder *current_;
+
+    std::filesystem::path path_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<RimeTraceEvent> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    uint64_t dropped_ = 0;
+    bool stopping_ = false;
+    uint64_t nextFlowId_ = 1;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMETRACING_H_
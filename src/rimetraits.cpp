@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimetraits.h"
+#include <fcitx-utils/log.h>
+#include <rime_api.h>
+
+namespace fcitx::rime {
+
+void fillRimeTraits(RimeTraits &traits, const char *sharedDataDir,
+                    const char *userDataDir, LogLevel logLevel) {
+    traits.shared_data_dir = sharedDataDir;
+    traits.app_name = "rime.fcitx-rime";
+    traits.user_data_dir = userDataDir;
+    traits.distribution_name = "Rime";
+    traits.distribution_code_name = "fcitx-rime";
+    traits.distribution_version = FCITX_RIME_VERSION;
+    // make librime only log to stderr
+    // https://github.com/rime/librime/commit/6d1b9b65de4e7784a68a17d10a3e5c900e4fd511
+    traits.log_dir = "";
+    switch (logLevel) {
+    case NoLog:
+        traits.min_log_level = 4;
+        break;
+    case Fatal:
+        traits.min_log_level = 3;
+        break;
+    case Error:
+    case Warn:
+    case Info:
+        traits.min_log_level = 2;
+        break;
+    case Debug:
+    default:
+        // Rime info is too noisy.
+        traits.min_log_level = 0;
+        break;
+    }
+
+    traits.modules = nullptr;
+}
+
+} // namespace fcitx::rime
@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMETRAITS_H_
+#define _FCITX_RIMETRAITS_H_
+
+#include <fcitx-utils/log.h>
+#include <rime_api.h>
+
+namespace fcitx::rime {
+
+// Fill the traits shared by the addon and fcitx5-rime-convert. traits must
+// be initialized with RIME_STRUCT, and the directories must outlive it.
+void fillRimeTraits(RimeTraits &traits, const char *sharedDataDir,
+                    const char *userDataDir, LogLevel logLevel);
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMETRAITS_H_
@@ -0,0 +1,176 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimewatchdog.h"
+#include "rimeengine.h"
+#include "rimemetrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcitx-utils/event.h>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fcitx::rime {
+
+RimeWatchdog::~RimeWatchdog() {
+    {
+        std::lock_guard lock(mutex_);
+        quit_ = true;
+    }
+    condition_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void RimeWatchdog::setThreshold(uint64_t threshold) {
+    {
+        std::lock_guard lock(mutex_);
+        threshold_ = threshold;
+        if (threshold && !thread_.joinable()) {
+            thread_ = std::thread(&RimeWatchdog::monitor, this);
+        }
+    }
+    condition_.notify_one();
+}
+
+std::vector<RimeSlowCall> RimeWatchdog::slowCalls() const {
+    std::lock_guard lock(mutex_);
+    std::vector<RimeSlowCall> result;
+    result.reserve(slowCalls_.size());
+    for (const auto &entry : slowCalls_) {
+        result.push_back(entry.call);
+    }
+    return result;
+}
+
+void RimeWatchdog::clear() {
+    std::lock_guard lock(mutex_);
+    slowCalls_.clear();
+}
+
+uint64_t RimeWatchdog::begin(const char *call, std::string_view schema,
+                             RimeSessionId session, uint32_t keysym,
+                             uint64_t start) {
+    bool wake = false;
+    uint64_t id;
+    {
+        std::lock_guard lock(mutex_);
+        id = nextId_++;
+        inFlight_.push_back({id, call, schema, session, keysym, start});
+        // Otherwise the monitor already waits for an earlier call.
+        wake = idle_;
+        idle_ = false;
+    }
+    if (wake) {
+        condition_.notify_one();
+    }
+    return id;
+}
+
+void RimeWatchdog::end(uint64_t id) {
+    std::lock_guard lock(mutex_);
+    inFlight_.remove_if([id](const InFlight &call) { return call.id == id; });
+}
+
+void RimeWatchdog::report(RimeSlowCall call, uint64_t watch) {
+    RIME_WARN() << (call.finished ? "Slow librime call: "
+                                  : "Slow librime call still running: ")
+                << call.call << " schema: " << call.schema
+                << " session: " << call.session << " keysym: " << call.keysym
+                << " input length: " << call.inputLength
+                << " elapsed: " << call.elapsed << "us";
+    std::lock_guard lock(mutex_);
+    // Replace the report made while the call was running.
+    std::erase_if(slowCalls_,
+                  [watch](const Entry &entry) { return entry.watch == watch; });
+    if (slowCalls_.size() == MaxSlowCalls &&
+        slowCalls_.back().call.elapsed >= call.elapsed) {
+        return;
+    }
+    auto iter = std::upper_bound(
+        slowCalls_.begin(), slowCalls_.end(), call.elapsed,
+        [](uint64_t elapsed, const Entry &entry) {
+            return elapsed > entry.call.elapsed;
+        });
+    slowCalls_.insert(iter, {std::move(call), watch});
+    if (slowCalls_.size() > MaxSlowCalls) {
+        slowCalls_.pop_back();
+    }
+}
+
+void RimeWatchdog::monitor() {
+    std::unique_lock lock(mutex_);
+    while (!quit_) {
+        // Find calls over the threshold, or when the next one will be.
+        const uint64_t threshold = threshold_ * 1000;
+        const uint64_t now = RimeMetrics::timestamp();
+        uint64_t deadline = 0;
+        std::vector<std::pair<RimeSlowCall, uint64_t>> running;
+        for (auto &call : inFlight_) {
+            if (call.reported || !threshold) {
+                continue;
+            }
+            if (call.start + threshold <= now) {
+                call.reported = true;
+                // librime may be blocked in the call, so the input is not
+                // known here.
+                running.emplace_back(
+                    RimeSlowCall{call.call, std::string(call.schema),
+                                 call.session, call.keysym, 0,
+                                 (now - call.start) / 1000,
+                                 fcitx::now(CLOCK_REALTIME), false},
+                    call.id);
+            } else if (!deadline || call.start + threshold < deadline) {
+                deadline = call.start + threshold;
+            }
+        }
+        if (!running.empty()) {
+            lock.unlock();
+            for (auto &[call, id] : running) {
+                report(std::move(call), id);
+            }
+            lock.lock();
+            continue;
+        }
+        if (deadline) {
+            condition_.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+        } else {
+            idle_ = true;
+            condition_.wait(lock);
+        }
+    }
+}
+
+RimeCallWatch::~RimeCallWatch() {
+    if (!start_) {
+        return;
+    }
+    watchdog_.end(id_);
+    const auto elapsed = (RimeMetrics::timestamp() - start_) / 1000;
+    if (elapsed < watchdog_.threshold()) {
+        return;
+    }
+    uint32_t inputLength = 0;
+    // get_input is only valid while the session is alive, and it is cheap.
+    if (session_ && api_->find_session(session_)) {
+        if (const char *input = api_->get_input(session_)) {
+            inputLength = std::strlen(input);
+        }
+    }
+    watchdog_.report({call_, std::string(schema_), session_, keysym_,
+                      inputLength, elapsed, now(CLOCK_REALTIME)},
+                     id_);
+}
+
+} // namespace fcitx::rime
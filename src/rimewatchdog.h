@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEWATCHDOG_H_
+#define _FCITX_RIMEWATCHDOG_H_
+
+#include "rimemetrics.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <rime_api.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fcitx::rime {
+
+struct RimeSlowCall {
+    std::string call;
+    std::string schema;
+    RimeSessionId session;
+    uint32_t keysym;
+    uint32_t inputLength;
+    // Elapsed time in microseconds, and wall clock time of the call.
+    uint64_t elapsed;
+    uint64_t time;
+    // False if the call hadn't returned yet, elapsed is the time until then.
+    bool finished = true;
+};
+
+// Log librime calls that take longer than the threshold, and keep the
+// slowest ones.
+//
+// Calls may be watched on any thread. A call is reported by a monitor thread
+// as soon as it exceeds the threshold, so a call that never returns is still
+// seen, and reported again with the final time once it returns.
+class RimeWatchdog {
+public:
+    static constexpr size_t MaxSlowCalls = 20;
+
+    RimeWatchdog() = default;
+    ~RimeWatchdog();
+
+    RimeWatchdog(const RimeWatchdog &) = delete;
+
+    // Threshold in microseconds, 0 to disable.
+    uint64_t threshold() const { return threshold_; }
+    void setThreshold(uint64_t threshold);
+
+    // Sorted from the slowest.
+    std::vector<RimeSlowCall> slowCalls() const;
+    void clear();
+
+private:
+    friend class RimeCallWatch;
+
+    struct InFlight {
+        uint64_t id;
+        const char *call;
+        std::string_view schema;
+        RimeSessionId session;
+        uint32_t keysym;
+        uint64_t start;
+        bool reported = false;
+    };
+
+    struct Entry {
+        RimeSlowCall call;
+        // Id of the watch that reported it.
+        uint64_t watch;
+    };
+
+    uint64_t begin(const char *call, std::string_view schema,
+                   RimeSessionId session, uint32_t keysym, uint64_t start);
+    void end(uint64_t id);
+    void report(RimeSlowCall call, uint64_t watch);
+    void monitor();
+
+    std::atomic<uint64_t> threshold_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<Entry> slowCalls_;
+    std::list<InFlight> inFlight_;
+    uint64_t nextId_ = 1;
+    // Whether the monitor waits without a deadline.
+    bool idle_ = false;
+    bool quit_ = false;
+    std::thread thread_;
+};
+
+// Watch a librime call in the scope. Schema must outlive the watch, and not
+// change while it is watched.
+class RimeCallWatch {
+public:
+    RimeCallWatch(RimeWatchdog &watchdog, rime_api_t *api, const char *call,
+                  RimeSessionId session, std::string_view schema = {},
+                  uint32_t keysym = 0)
+        : watchdog_(watchdog), api_(api), call_(call), session_(session),
+          schema_(schema), keysym_(keysym),
+          start_(watchdog.threshold() ? RimeMetrics::timestamp() : 0) {
+        if (start_) {
+            id_ = watchdog_.begin(call_, schema_, session_, keysym_, start_);
+        }
+    }
+
+    RimeCallWatch(const RimeCallWatch &) = delete;
+
+    ~RimeCallWatch();
+
+private:
+    RimeWatchdog &watchdog_;
+    rime_api_t *api_;
+    const char *call_;
+    RimeSessionId session_;
+    std::string_view schema_;
+    uint32_t keysym_;
+    uint64_t start_;
+    uint64_t id_ = 0;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEWATCHDOG_H_
@@ -0,0 +1,196 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "rimeworker.h"
+#include <cstddef>
+#include <fcitx-utils/event.h>
+#include <functional>
+#include <mutex>
+#include <rime_api.h>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace fcitx::rime {
+
+namespace {
+
+std::string copyString(const char *str) { return str ? str : ""; }
+
+char *stringPointer(const char *original, std::string &copy) {
+    return original ? copy.data() : nullptr;
+}
+
+thread_local RimeKeyResultScope *currentScope = nullptr;
+
+} // namespace
+
+RimeContextSnapshot::RimeContextSnapshot(const RimeContext &context)
+    : context_(context), preedit_(copyString(context.composition.preedit)),
+      commitTextPreview_(copyString(context.commit_text_preview)),
+      selectKeys_(copyString(context.menu.select_keys)) {
+    context_.composition.preedit =
+        stringPointer(context.composition.preedit, preedit_);
+    context_.commit_text_preview =
+        stringPointer(context.commit_text_preview, commitTextPreview_);
+    context_.menu.select_keys =
+        stringPointer(context.menu.select_keys, selectKeys_);
+
+    const auto &menu = context.menu;
+    const auto numCandidates =
+        menu.candidates ? static_cast<size_t>(menu.num_candidates) : 0;
+    // Fill all the strings first, so they won't move any more.
+    for (size_t i = 0; i < numCandidates; i++) {
+        texts_.push_back(copyString(menu.candidates[i].text));
+        comments_.push_back(copyString(menu.candidates[i].comment));
+    }
+    for (size_t i = 0; i < numCandidates; i++) {
+        candidates_.push_back(
+            {stringPointer(menu.candidates[i].text, texts_[i]),
+             stringPointer(menu.candidates[i].comment, comments_[i]),
+             nullptr});
+    }
+    context_.menu.candidates = candidates_.data();
+
+    if (RIME_STRUCT_HAS_MEMBER(context, context.select_labels) &&
+        context.select_labels) {
+        const auto numLabels = static_cast<size_t>(menu.page_size);
+        for (size_t i = 0; i < numLabels; i++) {
+            labels_.push_back(copyString(context.select_labels[i]));
+        }
+        for (size_t i = 0; i < numLabels; i++) {
+            labelPointers_.push_back(
+                stringPointer(context.select_labels[i], labels_[i]));
+        }
+        context_.select_labels = labelPointers_.data();
+    }
+}
+
+RimeStatusSnapshot::RimeStatusSnapshot(const RimeStatus &status)
+    : status_(status), schemaId_(copyString(status.schema_id)),
+      schemaName_(copyString(status.schema_name)) {
+    status_.schema_id = stringPointer(status.schema_id, schemaId_);
+    status_.schema_name = stringPointer(status.schema_name, schemaName_);
+}
+
+RimeKeyResultScope::RimeKeyResultScope(RimeKeyResult *result,
+                                       RimeSessionId session)
+    : result_(result), session_(session) {
+    currentScope = this;
+}
+
+RimeKeyResultScope::~RimeKeyResultScope() { currentScope = nullptr; }
+
+RimeKeyResult *RimeKeyResultScope::current(RimeSessionId session) {
+    if (!currentScope || currentScope->session_ != session) {
+        return nullptr;
+    }
+    return currentScope->result_;
+}
+
+RimeWorker::RimeWorker(EventDispatcher &dispatcher)
+    : dispatcher_(dispatcher) {}
+
+RimeWorker::~RimeWorker() { stop(); }
+
+void RimeWorker::start() {
+    if (running()) {
+        return;
+    }
+    ref_ = watch();
+    stopping_ = false;
+    thread_ = std::thread(&RimeWorker::run, this);
+}
+
+void RimeWorker::stop() {
+    if (!running()) {
+        return;
+    }
+    drain();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+}
+
+void RimeWorker::post(Task task) {
+    pending_ += 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void RimeWorker::drain() {
+    if (!running()) {
+        return;
+    }
+    wait();
+    dispatch();
+}
+
+void RimeWorker::wait() {
+    if (!running()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    idleCondition_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+void RimeWorker::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait(lock,
+                        [this]() { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+            return;
+        }
+        auto task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+
+        auto callback = task();
+
+        lock.lock();
+        const bool schedule = callbacks_.empty();
+        callbacks_.push_back(std::move(callback));
+        pending_ -= 1;
+        if (pending_ == 0) {
+            idleCondition_.notify_all();
+        }
+        if (schedule) {
+            dispatcher_.schedule([ref = *ref_]() {
+                if (auto *that = ref.get()) {
+                    that->dispatch();
+                }
+            });
+        }
+    }
+}
+
+void RimeWorker::dispatch() {
+    // A callback may call drain again, which continues with the callbacks
+    // after it.
+    while (true) {
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (callbacks_.empty()) {
+                break;
+            }
+            callback = std::move(callbacks_.front());
+            callbacks_.pop_front();
+        }
+        if (callback) {
+            callback();
+        }
+    }
+}
+
+} // namespace fcitx::rime
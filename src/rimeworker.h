@@ -0,0 +1,141 @@
+/*
+ * SPDX-FileCopyrightText: 2026~2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+#ifndef _FCITX_RIMEWORKER_H_
+#define _FCITX_RIMEWORKER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/trackableobject.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <rime_api.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fcitx::rime {
+
+// Copy of RimeContext that owns all of its strings, so it can be created on
+// the worker thread and used after the librime context is freed.
+class RimeContextSnapshot {
+public:
+    explicit RimeContextSnapshot(const RimeContext &context);
+
+    RimeContextSnapshot(const RimeContextSnapshot &) = delete;
+
+    const RimeContext &context() const { return context_; }
+
+private:
+    RimeContext context_;
+    std::string preedit_;
+    std::string commitTextPreview_;
+    std::string selectKeys_;
+    std::vector<std::string> texts_;
+    std::vector<std::string> comments_;
+    std::vector<std::string> labels_;
+    std::vector<RimeCandidate> candidates_;
+    std::vector<char *> labelPointers_;
+};
+
+// Copy of RimeStatus that owns all of its strings.
+class RimeStatusSnapshot {
+public:
+    explicit RimeStatusSnapshot(const RimeStatus &status);
+
+    RimeStatusSnapshot(const RimeStatusSnapshot &) = delete;
+
+    const RimeStatus &status() const { return status_; }
+
+private:
+    RimeStatus status_;
+    std::string schemaId_;
+    std::string schemaName_;
+};
+
+// Result of a key processed on the worker thread.
+struct RimeKeyResult {
+    bool accepted = false;
+    // Time spent in process_key, if latency budget is enabled.
+    std::optional<uint64_t> processKeyTime;
+    std::optional<std::string> commit;
+    // Commit preview that needs to be committed before the compose result,
+    // if rime can't handle the compose result.
+    std::string commitPreview;
+    std::shared_ptr<RimeContextSnapshot> context;
+    std::shared_ptr<RimeStatusSnapshot> status;
+    // Options changed by the key, as in option notification.
+    std::vector<std::string> changedOptions;
+};
+
+// Makes the result current on the worker thread while librime is called for
+// the session, so the notifications raised by the call go into the result.
+class RimeKeyResultScope {
+public:
+    RimeKeyResultScope(RimeKeyResult *result, RimeSessionId session);
+    ~RimeKeyResultScope();
+
+    RimeKeyResultScope(const RimeKeyResultScope &) = delete;
+
+    // Result of the call running for session on this thread, if any.
+    static RimeKeyResult *current(RimeSessionId session);
+
+private:
+    RimeKeyResult *result_;
+    RimeSessionId session_;
+};
+
+// A single thread that runs all librime calls while it is busy, tasks are
+// run in the order they are posted.
+//
+// A task returns a callback, which is run on the main thread in the same
+// order. Before calling librime from the main thread, drain() or wait() must
+// be called so the two threads never use librime at the same time.
+class RimeWorker : public TrackableObject<RimeWorker> {
+public:
+    using Task = std::function<std::function<void()>()>;
+
+    explicit RimeWorker(EventDispatcher &dispatcher);
+    ~RimeWorker();
+
+    void start();
+    // Finish all tasks and stop the thread.
+    void stop();
+    bool running() const { return thread_.joinable(); }
+
+    void post(Task task);
+    // Wait for all tasks, and run their callbacks. Callbacks may drain
+    // again, which runs the rest of them in order.
+    void drain();
+    // Wait for all tasks, but leave their callbacks to the event loop.
+    void wait();
+    bool idle() const { return pending_ == 0; }
+
+private:
+    void run();
+    void dispatch();
+
+    EventDispatcher &dispatcher_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::condition_variable idleCondition_;
+    std::deque<Task> tasks_;
+    std::deque<std::function<void()>> callbacks_;
+    // Tasks that are posted but not finished.
+    std::atomic<size_t> pending_ = 0;
+    bool stopping_ = false;
+    std::optional<TrackableObjectReference<RimeWorker>> ref_;
+};
+
+} // namespace fcitx::rime
+
+#endif // _FCITX_RIMEWORKER_H_